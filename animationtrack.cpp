@@ -0,0 +1,153 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "animationtrack.h"
+
+AnimationTrack::AnimationTrack()
+{
+}
+
+void AnimationTrack::addKeyframe(int frame, qreal focalLength,
+                                 const QList<RayEmitter> &emitters)
+{
+    Keyframe key;
+    key.frame = frame;
+    key.focalLength = focalLength;
+    key.emitters = emitters;
+
+    int i = 0;
+    while (i < m_keyframes.size() && m_keyframes.at(i).frame < frame) {
+        i++;
+    }
+
+    if (i < m_keyframes.size() && m_keyframes.at(i).frame == frame) {
+        m_keyframes[i] = key;
+    } else {
+        m_keyframes.insert(i, key);
+    }
+}
+
+void AnimationTrack::clear()
+{
+    m_keyframes.clear();
+}
+
+int AnimationTrack::keyframeCount() const
+{
+    return m_keyframes.size();
+}
+
+const Keyframe& AnimationTrack::keyframeAt(int index) const
+{
+    return m_keyframes.at(index);
+}
+
+int AnimationTrack::frameCount() const
+{
+    if (m_keyframes.isEmpty()) {
+        return 0;
+    }
+
+    return lastFrame() - firstFrame() + 1;
+}
+
+int AnimationTrack::firstFrame() const
+{
+    return m_keyframes.isEmpty() ? 0 : m_keyframes.first().frame;
+}
+
+int AnimationTrack::lastFrame() const
+{
+    return m_keyframes.isEmpty() ? 0 : m_keyframes.last().frame;
+}
+
+int AnimationTrack::segmentAt(int frame) const
+{
+    int segment = 0;
+
+    while (segment + 1 < m_keyframes.size()
+           && m_keyframes.at(segment + 1).frame <= frame) {
+        segment++;
+    }
+
+    return segment;
+}
+
+qreal AnimationTrack::segmentPosition(int segment, int frame) const
+{
+    if (segment + 1 >= m_keyframes.size()) {
+        return 0.0;
+    }
+
+    const Keyframe &from = m_keyframes.at(segment);
+    const Keyframe &to = m_keyframes.at(segment + 1);
+
+    qreal t = static_cast<qreal>(frame - from.frame) / (to.frame - from.frame);
+    return qBound(qreal(0.0), t, qreal(1.0));
+}
+
+qreal AnimationTrack::focalLengthAt(int frame) const
+{
+    if (m_keyframes.isEmpty()) {
+        return 0.0;
+    }
+
+    int segment = segmentAt(frame);
+    qreal t = segmentPosition(segment, frame);
+
+    qreal from = m_keyframes.at(segment).focalLength;
+
+    if (t == 0.0) {
+        return from;
+    }
+
+    qreal to = m_keyframes.at(segment + 1).focalLength;
+    return from + (to - from) * t;
+}
+
+QList<RayEmitter> AnimationTrack::emittersAt(int frame) const
+{
+    if (m_keyframes.isEmpty()) {
+        return QList<RayEmitter>();
+    }
+
+    int segment = segmentAt(frame);
+    qreal t = segmentPosition(segment, frame);
+
+    QList<RayEmitter> emitters = m_keyframes.at(segment).emitters;
+
+    if (t == 0.0) {
+        return emitters;
+    }
+
+    const QList<RayEmitter> &next = m_keyframes.at(segment + 1).emitters;
+
+    for (int i = 0; i < emitters.size() && i < next.size(); i++) {
+        RayEmitter &em = emitters[i];
+        const RayEmitter &target = next.at(i);
+
+        em.setPos(em.pos() + (target.pos() - em.pos()) * t);
+        em.setAngle(em.angle() + (target.angle() - em.angle()) * t);
+    }
+
+    return emitters;
+}
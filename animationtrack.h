@@ -0,0 +1,72 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef ANIMATIONTRACK_H
+#define ANIMATIONTRACK_H
+
+#include <QList>
+
+#include "rayemitter.h"
+
+// State of the scene at a given frame
+struct Keyframe
+{
+    int frame;
+    qreal focalLength;
+    QList<RayEmitter> emitters;
+};
+
+// Sequence of keyframes. Focal length and emitter positions/angles are
+// linearly interpolated between them.
+class AnimationTrack
+{
+public:
+    AnimationTrack();
+
+    // Replaces the keyframe if there is already one at this frame
+    void addKeyframe(int frame, qreal focalLength,
+                     const QList<RayEmitter> &emitters);
+    void clear();
+
+    int keyframeCount() const;
+    const Keyframe& keyframeAt(int index) const;
+
+    // Number of frames from the first keyframe to the last one inclusive
+    int frameCount() const;
+    int firstFrame() const;
+    int lastFrame() const;
+
+    qreal focalLengthAt(int frame) const;
+
+    // Emitters of the closest keyframe before the frame. Those also present
+    // in the next keyframe are interpolated towards it.
+    QList<RayEmitter> emittersAt(int frame) const;
+
+private:
+    // Index of the last keyframe at or before the frame
+    int segmentAt(int frame) const;
+    qreal segmentPosition(int segment, int frame) const;
+
+    QList<Keyframe> m_keyframes;
+};
+
+#endif // ANIMATIONTRACK_H
@@ -0,0 +1,348 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "editcommands.h"
+#include "renderwidget.h"
+
+enum CommandId {
+    EditEmitterId,
+    FocalLengthId,
+    ThickLensId,
+    MoveGroupId
+};
+
+EmitterFields EmitterFields::of(const RayEmitter &emitter)
+{
+    EmitterFields fields;
+    fields.pos = emitter.pos();
+    fields.angle = emitter.angle();
+    fields.wavelengths = emitter.spectrum().samples();
+
+    return fields;
+}
+
+int EmitterFields::diff(const EmitterFields &other) const
+{
+    int mask = 0;
+
+    if (pos != other.pos) {
+        mask |= Position;
+    }
+
+    if (angle != other.angle) {
+        mask |= Angle;
+    }
+
+    if (wavelengths != other.wavelengths) {
+        mask |= Wavelengths;
+    }
+
+    return mask;
+}
+
+void EmitterFields::assign(const EmitterFields &other, int mask)
+{
+    if (mask & Position) {
+        pos = other.pos;
+    }
+
+    if (mask & Angle) {
+        angle = other.angle;
+    }
+
+    if (mask & Wavelengths) {
+        wavelengths = other.wavelengths;
+    }
+}
+
+void EmitterFields::applyTo(RayEmitter &emitter, int mask) const
+{
+    if (mask & Position) {
+        emitter.setPos(pos);
+    }
+
+    if (mask & Angle) {
+        emitter.setAngle(angle);
+    }
+
+    if (mask & Wavelengths) {
+        emitter.setSpectrum(Spectrum(wavelengths));
+    }
+}
+
+EditEmitterCommand::EditEmitterCommand(RenderWidget *widget, int index,
+                                       const EmitterFields &before,
+                                       const EmitterFields &after) :
+    m_widget(widget),
+    m_index(index),
+    m_mask(before.diff(after)),
+    m_before(before),
+    m_after(after)
+{
+}
+
+void EditEmitterCommand::undo()
+{
+    RayEmitter emitter = m_widget->emitterAt(m_index);
+    m_before.applyTo(emitter, m_mask);
+    m_widget->replaceEmitter(m_index, emitter);
+}
+
+void EditEmitterCommand::redo()
+{
+    RayEmitter emitter = m_widget->emitterAt(m_index);
+    m_after.applyTo(emitter, m_mask);
+    m_widget->replaceEmitter(m_index, emitter);
+}
+
+int EditEmitterCommand::id() const
+{
+    return EditEmitterId;
+}
+
+bool EditEmitterCommand::mergeWith(const EditCommand *other)
+{
+    const EditEmitterCommand *edit = static_cast<const EditEmitterCommand *>(other);
+
+    if (edit->m_index != m_index) {
+        return false;
+    }
+
+    // Fields changed only by the other command start from its before state
+    m_before.assign(edit->m_before, edit->m_mask & ~m_mask);
+    m_after.assign(edit->m_after, edit->m_mask);
+    m_mask |= edit->m_mask;
+
+    return true;
+}
+
+int EditEmitterCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this));
+}
+
+bool EditEmitterCommand::isEmpty() const
+{
+    return m_mask == 0;
+}
+
+InsertEmittersCommand::InsertEmittersCommand(RenderWidget *widget, int index,
+                                             const QList<RayEmitter> &emitters) :
+    m_widget(widget),
+    m_index(index),
+    m_emitters(emitters)
+{
+}
+
+void InsertEmittersCommand::undo()
+{
+    m_widget->takeEmitters(m_index, m_emitters.size());
+}
+
+void InsertEmittersCommand::redo()
+{
+    m_widget->insertEmitters(m_index, m_emitters);
+}
+
+int InsertEmittersCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this)
+            + m_emitters.size() * (sizeof(RayEmitter) + sizeof(void *)));
+}
+
+RemoveEmittersCommand::RemoveEmittersCommand(RenderWidget *widget, int index,
+                                             int count) :
+    m_widget(widget),
+    m_index(index),
+    m_count(count)
+{
+}
+
+void RemoveEmittersCommand::undo()
+{
+    m_widget->insertEmitters(m_index, m_emitters);
+    m_emitters.clear();
+}
+
+void RemoveEmittersCommand::redo()
+{
+    m_emitters = m_widget->takeEmitters(m_index, m_count);
+}
+
+int RemoveEmittersCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this)
+            + m_count * (sizeof(RayEmitter) + sizeof(void *)));
+}
+
+FocalLengthCommand::FocalLengthCommand(RenderWidget *widget, qreal before,
+                                       qreal after) :
+    m_widget(widget),
+    m_before(before),
+    m_after(after)
+{
+}
+
+void FocalLengthCommand::undo()
+{
+    m_widget->setLensFocalLength(m_before);
+}
+
+void FocalLengthCommand::redo()
+{
+    m_widget->setLensFocalLength(m_after);
+}
+
+int FocalLengthCommand::id() const
+{
+    return FocalLengthId;
+}
+
+bool FocalLengthCommand::mergeWith(const EditCommand *other)
+{
+    m_after = static_cast<const FocalLengthCommand *>(other)->m_after;
+    return true;
+}
+
+int FocalLengthCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this));
+}
+
+ThickLensCommand::ThickLensCommand(RenderWidget *widget, const ThickLens &before,
+                                   const ThickLens &after) :
+    m_widget(widget),
+    m_before(before),
+    m_after(after)
+{
+}
+
+void ThickLensCommand::undo()
+{
+    m_widget->setThickLens(m_before);
+}
+
+void ThickLensCommand::redo()
+{
+    m_widget->setThickLens(m_after);
+}
+
+int ThickLensCommand::id() const
+{
+    return ThickLensId;
+}
+
+bool ThickLensCommand::mergeWith(const EditCommand *other)
+{
+    m_after = static_cast<const ThickLensCommand *>(other)->m_after;
+    return true;
+}
+
+int ThickLensCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this));
+}
+
+MoveGroupCommand::MoveGroupCommand(RenderWidget *widget, int index,
+                                   const QPointF &before, const QPointF &after) :
+    m_widget(widget),
+    m_index(index),
+    m_before(before),
+    m_after(after)
+{
+}
+
+void MoveGroupCommand::undo()
+{
+    m_widget->setGroupPos(m_index, m_before);
+}
+
+void MoveGroupCommand::redo()
+{
+    m_widget->setGroupPos(m_index, m_after);
+}
+
+int MoveGroupCommand::id() const
+{
+    return MoveGroupId;
+}
+
+bool MoveGroupCommand::mergeWith(const EditCommand *other)
+{
+    const MoveGroupCommand *move = static_cast<const MoveGroupCommand *>(other);
+
+    if (move->m_index != m_index) {
+        return false;
+    }
+
+    m_after = move->m_after;
+    return true;
+}
+
+int MoveGroupCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this));
+}
+
+InsertGroupCommand::InsertGroupCommand(RenderWidget *widget, int index,
+                                       const EmitterGroup &group, bool remove) :
+    m_widget(widget),
+    m_index(index),
+    m_group(group),
+    m_remove(remove)
+{
+}
+
+void InsertGroupCommand::undo()
+{
+    if (m_remove) {
+        insert();
+    } else {
+        remove();
+    }
+}
+
+void InsertGroupCommand::redo()
+{
+    if (m_remove) {
+        remove();
+    } else {
+        insert();
+    }
+}
+
+void InsertGroupCommand::insert()
+{
+    m_widget->insertGroup(m_index, m_group);
+}
+
+void InsertGroupCommand::remove()
+{
+    m_group = m_widget->takeGroup(m_index);
+}
+
+int InsertGroupCommand::byteSize() const
+{
+    return static_cast<int>(sizeof(*this)
+            + m_group.prototype().size() * (sizeof(RayEmitter) + sizeof(void *))
+            + m_group.instances().size() * sizeof(EmitterInstance));
+}
@@ -0,0 +1,202 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef EDITCOMMANDS_H
+#define EDITCOMMANDS_H
+
+#include <QList>
+#include <QPointF>
+
+#include "editjournal.h"
+#include "rayemitter.h"
+#include "emittergroup.h"
+#include "thicklens.h"
+
+class RenderWidget;
+
+// Editable fields of an emitter
+struct EmitterFields
+{
+    enum Field {
+        Position = 0x1,
+        Angle = 0x2,
+        Wavelengths = 0x4
+    };
+
+    static EmitterFields of(const RayEmitter &emitter);
+
+    // Mask of fields which differ
+    int diff(const EmitterFields &other) const;
+
+    // Copies the fields in the mask from another set
+    void assign(const EmitterFields &other, int mask);
+
+    // Copies the fields in the mask to the emitter
+    void applyTo(RayEmitter &emitter, int mask) const;
+
+    QPointF pos;
+    qreal angle;
+    int wavelengths;
+};
+
+// Change of some fields of one emitter
+class EditEmitterCommand : public EditCommand
+{
+public:
+    EditEmitterCommand(RenderWidget *widget, int index,
+                       const EmitterFields &before, const EmitterFields &after);
+
+    void undo();
+    void redo();
+
+    int id() const;
+    bool mergeWith(const EditCommand *other);
+    int byteSize() const;
+
+    // True if the command would change nothing
+    bool isEmpty() const;
+
+private:
+    RenderWidget *m_widget;
+    int m_index;
+    int m_mask;
+    EmitterFields m_before;
+    EmitterFields m_after;
+};
+
+// Insertion of consecutive emitters
+class InsertEmittersCommand : public EditCommand
+{
+public:
+    InsertEmittersCommand(RenderWidget *widget, int index,
+                          const QList<RayEmitter> &emitters);
+
+    void undo();
+    void redo();
+
+    int byteSize() const;
+
+private:
+    RenderWidget *m_widget;
+    int m_index;
+    QList<RayEmitter> m_emitters;
+};
+
+// Removal of consecutive emitters
+class RemoveEmittersCommand : public EditCommand
+{
+public:
+    RemoveEmittersCommand(RenderWidget *widget, int index, int count);
+
+    void undo();
+    void redo();
+
+    int byteSize() const;
+
+private:
+    RenderWidget *m_widget;
+    int m_index;
+    int m_count;
+
+    // Filled when the command is done
+    QList<RayEmitter> m_emitters;
+};
+
+class FocalLengthCommand : public EditCommand
+{
+public:
+    FocalLengthCommand(RenderWidget *widget, qreal before, qreal after);
+
+    void undo();
+    void redo();
+
+    int id() const;
+    bool mergeWith(const EditCommand *other);
+    int byteSize() const;
+
+private:
+    RenderWidget *m_widget;
+    qreal m_before;
+    qreal m_after;
+};
+
+class ThickLensCommand : public EditCommand
+{
+public:
+    ThickLensCommand(RenderWidget *widget, const ThickLens &before, const ThickLens &after);
+
+    void undo();
+    void redo();
+
+    int id() const;
+    bool mergeWith(const EditCommand *other);
+    int byteSize() const;
+
+private:
+    RenderWidget *m_widget;
+    ThickLens m_before;
+    ThickLens m_after;
+};
+
+class MoveGroupCommand : public EditCommand
+{
+public:
+    MoveGroupCommand(RenderWidget *widget, int index,
+                     const QPointF &before, const QPointF &after);
+
+    void undo();
+    void redo();
+
+    int id() const;
+    bool mergeWith(const EditCommand *other);
+    int byteSize() const;
+
+private:
+    RenderWidget *m_widget;
+    int m_index;
+    QPointF m_before;
+    QPointF m_after;
+};
+
+// Insertion (or removal, if inverted) of one group
+class InsertGroupCommand : public EditCommand
+{
+public:
+    InsertGroupCommand(RenderWidget *widget, int index, const EmitterGroup &group,
+                       bool remove = false);
+
+    void undo();
+    void redo();
+
+    int byteSize() const;
+
+private:
+    void insert();
+    void remove();
+
+    RenderWidget *m_widget;
+    int m_index;
+    EmitterGroup m_group;
+    bool m_remove;
+};
+
+#endif // EDITCOMMANDS_H
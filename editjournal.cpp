@@ -0,0 +1,205 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "editjournal.h"
+
+const qint64 kDefaultMemoryLimit = 64 * 1024 * 1024;
+
+EditCommand::EditCommand() :
+    m_mergeKey(0)
+{
+}
+
+EditCommand::~EditCommand()
+{
+}
+
+int EditCommand::id() const
+{
+    return -1;
+}
+
+int EditCommand::mergeKey() const
+{
+    return m_mergeKey;
+}
+
+void EditCommand::setMergeKey(int key)
+{
+    m_mergeKey = key;
+}
+
+bool EditCommand::mergeWith(const EditCommand *other)
+{
+    Q_UNUSED(other)
+    return false;
+}
+
+EditJournal::EditJournal(QObject *parent) :
+    QObject(parent),
+    m_index(0),
+    m_memoryUsage(0),
+    m_memoryLimit(kDefaultMemoryLimit)
+{
+}
+
+EditJournal::~EditJournal()
+{
+    qDeleteAll(m_commands);
+}
+
+void EditJournal::push(EditCommand *command)
+{
+    bool couldUndo = canUndo();
+    bool couldRedo = canRedo();
+
+    // Undone commands can not be redone after a new change
+    while (m_commands.size() > m_index) {
+        EditCommand *undone = m_commands.takeLast();
+        m_memoryUsage -= undone->byteSize();
+        delete undone;
+    }
+
+    command->redo();
+
+    EditCommand *last = m_index > 0 ? m_commands.at(m_index - 1) : 0;
+
+    if (last && command->mergeKey() != 0 && last->mergeKey() == command->mergeKey()
+            && last->id() != -1 && last->id() == command->id()) {
+        int oldSize = last->byteSize();
+
+        if (last->mergeWith(command)) {
+            m_memoryUsage += last->byteSize() - oldSize;
+            delete command;
+
+            // The merged command may have grown
+            trim();
+            notify(couldUndo, couldRedo);
+            return;
+        }
+    }
+
+    m_commands.append(command);
+    m_memoryUsage += command->byteSize();
+    m_index++;
+
+    trim();
+    notify(couldUndo, couldRedo);
+}
+
+bool EditJournal::canUndo() const
+{
+    return m_index > 0;
+}
+
+bool EditJournal::canRedo() const
+{
+    return m_index < m_commands.size();
+}
+
+int EditJournal::count() const
+{
+    return m_commands.size();
+}
+
+qint64 EditJournal::memoryLimit() const
+{
+    return m_memoryLimit;
+}
+
+void EditJournal::setMemoryLimit(qint64 bytes)
+{
+    bool couldUndo = canUndo();
+    bool couldRedo = canRedo();
+
+    m_memoryLimit = bytes;
+    trim();
+
+    notify(couldUndo, couldRedo);
+}
+
+qint64 EditJournal::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+void EditJournal::clear()
+{
+    bool couldUndo = canUndo();
+    bool couldRedo = canRedo();
+
+    qDeleteAll(m_commands);
+    m_commands.clear();
+    m_index = 0;
+    m_memoryUsage = 0;
+
+    notify(couldUndo, couldRedo);
+}
+
+void EditJournal::undo()
+{
+    if (!canUndo()) {
+        return;
+    }
+
+    bool couldRedo = canRedo();
+
+    m_commands.at(--m_index)->undo();
+
+    notify(true, couldRedo);
+}
+
+void EditJournal::redo()
+{
+    if (!canRedo()) {
+        return;
+    }
+
+    bool couldUndo = canUndo();
+
+    m_commands.at(m_index++)->redo();
+
+    notify(couldUndo, false);
+}
+
+void EditJournal::trim()
+{
+    // The last command is kept even if it alone is over the limit
+    while (m_memoryUsage > m_memoryLimit && m_commands.size() > 1 && m_index > 0) {
+        EditCommand *oldest = m_commands.takeFirst();
+        m_memoryUsage -= oldest->byteSize();
+        m_index--;
+
+        delete oldest;
+    }
+}
+
+void EditJournal::notify(bool couldUndo, bool couldRedo)
+{
+    if (canUndo() != couldUndo) {
+        emit canUndoChanged(canUndo());
+    }
+
+    if (canRedo() != couldRedo) {
+        emit canRedoChanged(canRedo());
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QObject>
+#include <QList>
+
+// Change of the scene which can be undone. Commands keep only what they
+// change, never a copy of the whole scene.
+class EditCommand
+{
+public:
+    EditCommand();
+    virtual ~EditCommand();
+
+    virtual void undo() = 0;
+    virtual void redo() = 0;
+
+    // Commands of the same kind return the same id, -1 if they never merge
+    virtual int id() const;
+
+    // Commands with the same non-zero merge key and id may be merged into
+    // one, e.g. all the moves of a single mouse drag
+    int mergeKey() const;
+    void setMergeKey(int key);
+
+    // Takes over the result of the other command, which is executed after
+    // this one. Returns false if they can not be merged.
+    virtual bool mergeWith(const EditCommand *other);
+
+    // Approximate memory used by the command in bytes
+    virtual int byteSize() const = 0;
+
+private:
+    int m_mergeKey;
+};
+
+// Undo/redo history. Oldest commands are dropped once the history takes
+// more than memoryLimit() bytes.
+class EditJournal : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EditJournal(QObject *parent = 0);
+    ~EditJournal();
+
+    // Executes the command and records it, taking ownership
+    void push(EditCommand *command);
+
+    bool canUndo() const;
+    bool canRedo() const;
+
+    // Number of commands, both done and undone
+    int count() const;
+
+    qint64 memoryLimit() const;
+    void setMemoryLimit(qint64 bytes);
+
+    qint64 memoryUsage() const;
+
+    void clear();
+
+public slots:
+    void undo();
+    void redo();
+
+signals:
+    void canUndoChanged(bool canUndo);
+    void canRedoChanged(bool canRedo);
+
+private:
+    void trim();
+    void notify(bool couldUndo, bool couldRedo);
+
+    QList<EditCommand *> m_commands;
+
+    // Number of commands done, the next one to undo is m_index - 1
+    int m_index;
+
+    qint64 m_memoryUsage;
+    qint64 m_memoryLimit;
+};
+
+#endif // EDITJOURNAL_H
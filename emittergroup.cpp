@@ -0,0 +1,156 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "emittergroup.h"
+#include "thicklens.h"
+
+#include <qmath.h>
+
+EmitterGroup::EmitterGroup()
+{
+}
+
+QPointF EmitterGroup::pos() const
+{
+    return m_position;
+}
+
+void EmitterGroup::setPos(const QPointF &pos)
+{
+    m_position = pos;
+}
+
+QColor EmitterGroup::color() const
+{
+    return m_color;
+}
+
+void EmitterGroup::setColor(const QColor &color)
+{
+    m_color = color;
+}
+
+const QList<RayEmitter>& EmitterGroup::prototype() const
+{
+    return m_prototype;
+}
+
+void EmitterGroup::setPrototype(const QList<RayEmitter> &prototype)
+{
+    m_prototype = prototype;
+}
+
+const QVector<EmitterInstance>& EmitterGroup::instances() const
+{
+    return m_instances;
+}
+
+void EmitterGroup::setInstances(const QVector<EmitterInstance> &instances)
+{
+    m_instances = instances;
+}
+
+int EmitterGroup::rayCount() const
+{
+    return m_prototype.size() * m_instances.size();
+}
+
+RayEmitter EmitterGroup::emitterAt(int instance, int ray) const
+{
+    const EmitterInstance &inst = m_instances.at(instance);
+    const RayEmitter &proto = m_prototype.at(ray);
+
+    qreal c = qCos(inst.rotation);
+    qreal s = qSin(inst.rotation);
+
+    QPointF p = proto.pos();
+    QPointF pos = m_position + inst.offset + QPointF(c * p.x() - s * p.y(),
+                                                     s * p.x() + c * p.y());
+
+    RayEmitter em(pos, proto.angle() + inst.rotation);
+    em.setColor(m_color);
+
+    return em;
+}
+
+void EmitterGroup::expand(RayBatch &rays, int first, int count) const
+{
+    if (count <= 0) {
+        return;
+    }
+
+    int start = rays.size();
+    rays.resize(start + count);
+
+    double *x = rays.x.data() + start;
+    double *y = rays.y.data() + start;
+    double *dx = rays.dx.data() + start;
+    double *dy = rays.dy.data() + start;
+
+    const int prototypeSize = m_prototype.size();
+    const int end = first + count;
+
+    for (int i = first / prototypeSize; i * prototypeSize < end; i++) {
+        const EmitterInstance &inst = m_instances.at(i);
+
+        qreal c = qCos(inst.rotation);
+        qreal s = qSin(inst.rotation);
+
+        QPointF origin = m_position + inst.offset;
+
+        int from = qMax(first - i * prototypeSize, 0);
+        int to = qMin(end - i * prototypeSize, prototypeSize);
+
+        for (int j = from; j < to; j++) {
+            const RayEmitter &proto = m_prototype.at(j);
+            QPointF p = proto.pos();
+            qreal angle = proto.angle() + inst.rotation;
+
+            *x++ = origin.x() + c * p.x() - s * p.y();
+            *y++ = origin.y() + s * p.x() + c * p.y();
+            *dx++ = qCos(angle);
+            *dy++ = qSin(angle);
+        }
+    }
+}
+
+EmitterGroup EmitterGroup::fan(int rays, qreal spread, int heights, qreal spacing)
+{
+    QList<RayEmitter> prototype;
+
+    for (int i = 0; i < rays; i++) {
+        qreal angle = rays == 1 ? 0.0 : -spread / 2 + spread * i / (rays - 1);
+        prototype.append(RayEmitter(QPointF(0.0, 0.0), angle));
+    }
+
+    QVector<EmitterInstance> instances;
+
+    for (int i = 0; i < heights; i++) {
+        instances.append(EmitterInstance(QPointF(0.0, i * spacing)));
+    }
+
+    EmitterGroup group;
+    group.setPrototype(prototype);
+    group.setInstances(instances);
+
+    return group;
+}
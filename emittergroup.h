@@ -0,0 +1,91 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef EMITTERGROUP_H
+#define EMITTERGROUP_H
+
+#include <QList>
+#include <QVector>
+#include <QPointF>
+#include <QColor>
+
+#include "rayemitter.h"
+
+struct RayBatch;
+
+// Placement of one copy of the prototype rays inside a group
+struct EmitterInstance
+{
+    EmitterInstance(const QPointF &offset = QPointF(), qreal rotation = 0.0)
+        : offset(offset), rotation(rotation) {}
+
+    // Relative to the group position
+    QPointF offset;
+
+    // Radians, around the instance origin
+    qreal rotation;
+};
+
+// Set of prototype rays repeated at several places. Only the prototype and
+// the instance transforms are stored; the rays of each instance are
+// computed when needed. Moving the group changes its position only.
+class EmitterGroup
+{
+public:
+    EmitterGroup();
+
+    QPointF pos() const;
+    void setPos(const QPointF &pos);
+
+    QColor color() const;
+    void setColor(const QColor &color);
+
+    // Rays relative to the instance origin
+    const QList<RayEmitter>& prototype() const;
+    void setPrototype(const QList<RayEmitter> &prototype);
+
+    const QVector<EmitterInstance>& instances() const;
+    void setInstances(const QVector<EmitterInstance> &instances);
+
+    // Number of rays of all the instances
+    int rayCount() const;
+
+    // Prototype ray transformed by the instance
+    RayEmitter emitterAt(int instance, int ray) const;
+
+    // Appends count rays starting from first to the batch. Rays are
+    // numbered instance by instance, as in rayCount().
+    void expand(RayBatch &rays, int first, int count) const;
+
+    // Fan of rays spread evenly over the angle (radians) from one point,
+    // repeated at heights spacing apart
+    static EmitterGroup fan(int rays, qreal spread, int heights, qreal spacing);
+
+private:
+    QPointF m_position;
+    QColor m_color;
+
+    QList<RayEmitter> m_prototype;
+    QVector<EmitterInstance> m_instances;
+};
+
+#endif // EMITTERGROUP_H
@@ -0,0 +1,240 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "eventrecorder.h"
+#include "json.h"
+
+#include <QWidget>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QAbstractSlider>
+#include <QComboBox>
+#include <QListWidget>
+#include <QAbstractButton>
+
+EventRecorder::EventRecorder(QObject *parent) :
+    QObject(parent),
+    m_input(0)
+{
+}
+
+EventRecorder::~EventRecorder()
+{
+    stop();
+}
+
+void EventRecorder::setInputWidget(QWidget *widget)
+{
+    if (m_input) {
+        m_input->removeEventFilter(this);
+    }
+
+    m_input = widget;
+    m_input->installEventFilter(this);
+}
+
+void EventRecorder::addControl(QWidget *control)
+{
+    // The replay could not find it again
+    if (control->objectName().isEmpty()) {
+        return;
+    }
+
+    if (qobject_cast<QSpinBox *>(control)) {
+        connect(control, SIGNAL(valueChanged(int)), SLOT(controlChanged(int)));
+    } else if (qobject_cast<QDoubleSpinBox *>(control)) {
+        connect(control, SIGNAL(valueChanged(double)), SLOT(controlChanged(double)));
+    } else if (qobject_cast<QAbstractSlider *>(control)) {
+        connect(control, SIGNAL(valueChanged(int)), SLOT(controlChanged(int)));
+    } else if (qobject_cast<QComboBox *>(control)) {
+        connect(control, SIGNAL(currentIndexChanged(int)), SLOT(controlChanged(int)));
+    } else if (qobject_cast<QListWidget *>(control)) {
+        connect(control, SIGNAL(currentRowChanged(int)), SLOT(controlChanged(int)));
+    } else if (qobject_cast<QAbstractButton *>(control)) {
+        connect(control, SIGNAL(clicked()), SLOT(controlClicked()));
+    }
+}
+
+bool EventRecorder::start(const QString &fileName)
+{
+    stop();
+
+    m_file.setFileName(fileName);
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    m_error.clear();
+    m_timer.start();
+
+    // The replay starts with the size the session started with
+    if (m_input) {
+        QVariantMap record;
+        record["event"] = "resize";
+        record["width"] = m_input->width();
+        record["height"] = m_input->height();
+        write(record);
+    }
+
+    return true;
+}
+
+void EventRecorder::stop()
+{
+    m_file.close();
+}
+
+bool EventRecorder::isRecording() const
+{
+    return m_file.isOpen();
+}
+
+QString EventRecorder::errorString() const
+{
+    return m_error;
+}
+
+bool EventRecorder::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched != m_input || !isRecording()) {
+        return false;
+    }
+
+    QVariantMap record;
+
+    switch (event->type()) {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove: {
+        QMouseEvent *mouse = static_cast<QMouseEvent *>(event);
+
+        if (event->type() == QEvent::MouseButtonPress) {
+            record["event"] = "press";
+        } else if (event->type() == QEvent::MouseButtonRelease) {
+            record["event"] = "release";
+        } else if (event->type() == QEvent::MouseButtonDblClick) {
+            record["event"] = "doubleClick";
+        } else {
+            record["event"] = "move";
+        }
+
+        record["x"] = mouse->x();
+        record["y"] = mouse->y();
+        record["button"] = static_cast<int>(mouse->button());
+        record["buttons"] = static_cast<int>(mouse->buttons());
+        record["modifiers"] = static_cast<int>(mouse->modifiers());
+        break;
+    }
+    case QEvent::Wheel: {
+        QWheelEvent *wheel = static_cast<QWheelEvent *>(event);
+
+        record["event"] = "wheel";
+        record["x"] = wheel->x();
+        record["y"] = wheel->y();
+        record["delta"] = wheel->delta();
+        record["orientation"] = static_cast<int>(wheel->orientation());
+        record["buttons"] = static_cast<int>(wheel->buttons());
+        record["modifiers"] = static_cast<int>(wheel->modifiers());
+        break;
+    }
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease: {
+        QKeyEvent *key = static_cast<QKeyEvent *>(event);
+
+        record["event"] = event->type() == QEvent::KeyPress ? "keyPress" : "keyRelease";
+        record["key"] = key->key();
+        record["modifiers"] = static_cast<int>(key->modifiers());
+        record["text"] = key->text();
+        record["autoRepeat"] = key->isAutoRepeat();
+        break;
+    }
+    case QEvent::Resize: {
+        QResizeEvent *resize = static_cast<QResizeEvent *>(event);
+
+        record["event"] = "resize";
+        record["width"] = resize->size().width();
+        record["height"] = resize->size().height();
+        break;
+    }
+    default:
+        return false;
+    }
+
+    write(record);
+
+    return false;
+}
+
+void EventRecorder::controlChanged(int value)
+{
+    if (!isRecording()) {
+        return;
+    }
+
+    QVariantMap record;
+    record["event"] = "control";
+    record["name"] = sender()->objectName();
+    record["value"] = value;
+
+    write(record);
+}
+
+void EventRecorder::controlChanged(double value)
+{
+    if (!isRecording()) {
+        return;
+    }
+
+    QVariantMap record;
+    record["event"] = "control";
+    record["name"] = sender()->objectName();
+    record["value"] = value;
+
+    write(record);
+}
+
+void EventRecorder::controlClicked()
+{
+    if (!isRecording()) {
+        return;
+    }
+
+    QVariantMap record;
+    record["event"] = "click";
+    record["name"] = sender()->objectName();
+
+    write(record);
+}
+
+void EventRecorder::write(QVariantMap record)
+{
+    record["t"] = m_timer.nsecsElapsed();
+
+    m_file.write(Json::serialize(record));
+    m_file.write("\n");
+}
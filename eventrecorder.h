@@ -0,0 +1,78 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef EVENTRECORDER_H
+#define EVENTRECORDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QVariantMap>
+
+class QWidget;
+
+// Records a session of user input to a file for EventReplayer: the mouse,
+// wheel, key and resize events of one widget and the changes of some
+// controls. Every line of the file is a JSON object with the time "t" in
+// nanoseconds since the start and the "event" name, e.g.
+//
+// {"button":1,"buttons":1,"event":"press","modifiers":0,"t":1520000,"x":310,"y":200}
+// {"event":"control","name":"focalLengthBox","t":9800000,"value":25}
+class EventRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EventRecorder(QObject *parent = 0);
+    ~EventRecorder();
+
+    void setInputWidget(QWidget *widget);
+
+    // Value changes of spin boxes, sliders and combo boxes, current rows of
+    // list widgets and clicks of buttons are recorded by object name.
+    // Controls without a name are ignored.
+    void addControl(QWidget *control);
+
+    bool start(const QString &fileName);
+    void stop();
+
+    bool isRecording() const;
+    QString errorString() const;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event);
+
+private slots:
+    void controlChanged(int value);
+    void controlChanged(double value);
+    void controlClicked();
+
+private:
+    void write(QVariantMap record);
+
+    QWidget *m_input;
+
+    QFile m_file;
+    QElapsedTimer m_timer;
+    QString m_error;
+};
+
+#endif // EVENTRECORDER_H
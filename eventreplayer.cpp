@@ -0,0 +1,341 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "eventreplayer.h"
+#include "json.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QWidget>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QAbstractSlider>
+#include <QComboBox>
+#include <QListWidget>
+#include <QAbstractButton>
+
+// Shorter waits for the next event are spent spinning
+const qint64 kMinSleep = 2000000;
+
+EventReplayer::EventReplayer(QObject *parent) :
+    QObject(parent),
+    m_input(0),
+    m_controlParent(0),
+    m_maximumSpeed(false),
+    m_duration(0)
+{
+}
+
+bool EventReplayer::load(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_error = file.errorString();
+        return false;
+    }
+
+    m_records.clear();
+
+    for (int line = 1; !file.atEnd(); line++) {
+        QByteArray data = file.readLine().trimmed();
+
+        if (data.isEmpty()) {
+            continue;
+        }
+
+        bool ok;
+        QVariantMap record = Json::parse(data, &ok).toMap();
+
+        if (!ok || !record.contains("event") || !record.contains("t")) {
+            m_error = tr("Line %1 is not an event").arg(line);
+            return false;
+        }
+
+        m_records << record;
+    }
+
+    m_error.clear();
+
+    return true;
+}
+
+QString EventReplayer::errorString() const
+{
+    return m_error;
+}
+
+int EventReplayer::eventCount() const
+{
+    return m_records.size();
+}
+
+void EventReplayer::setInputWidget(QWidget *widget)
+{
+    m_input = widget;
+}
+
+void EventReplayer::setControlParent(QWidget *widget)
+{
+    m_controlParent = widget;
+}
+
+void EventReplayer::setMaximumSpeed(bool maximum)
+{
+    m_maximumSpeed = maximum;
+}
+
+bool EventReplayer::maximumSpeed() const
+{
+    return m_maximumSpeed;
+}
+
+void EventReplayer::run()
+{
+    for (int i = 0; i < KindCount; i++) {
+        m_latencies[i].clear();
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    for (int i = 0; i < m_records.size(); i++) {
+        const QVariantMap &record = m_records.at(i);
+        qint64 due = record.value("t").toLongLong();
+
+        if (!m_maximumSpeed) {
+            qint64 wait = due - clock.nsecsElapsed();
+
+            // Events arriving meanwhile are handled as in a live session
+            if (wait > kMinSleep) {
+                QEventLoop loop;
+                QTimer::singleShot(static_cast<int>((wait - kMinSleep / 2) / 1000000),
+                                   &loop, SLOT(quit()));
+                loop.exec();
+            }
+
+            while (clock.nsecsElapsed() < due) {
+            }
+        }
+
+        qint64 start = m_maximumSpeed ? clock.nsecsElapsed() : due;
+        Kind kind;
+
+        if (!dispatch(record, &kind)) {
+            continue;
+        }
+
+        // Queued signals run before the frame, as they would before the next
+        // paint. Work the render widget coalesces with timers, such as the
+        // aperture statistics, is done by its paint and so measured too.
+        QCoreApplication::processEvents();
+        renderFrame();
+
+        m_latencies[kind] << clock.nsecsElapsed() - start;
+    }
+
+    m_duration = clock.nsecsElapsed();
+}
+
+void EventReplayer::report() const
+{
+    QTextStream out(stdout);
+
+    int count = 0;
+
+    for (int i = 0; i < KindCount; i++) {
+        count += m_latencies[i].size();
+    }
+
+    out << "events:      " << count << (m_maximumSpeed ? " (maximum speed)" : " (recorded speed)")
+        << endl;
+    out << "duration:    " << m_duration / 1e9 << " s" << endl;
+
+    const char *const names[KindCount] = { "mouse", "wheel", "key", "control" };
+    const int percentiles[] = { 50, 90, 99, 100 };
+
+    for (int i = 0; i < KindCount; i++) {
+        if (m_latencies[i].isEmpty()) {
+            continue;
+        }
+
+        QVector<qint64> latencies = m_latencies[i];
+        qSort(latencies);
+
+        out << QString("%1").arg(names[i], -13) << latencies.size() << " events,";
+
+        for (int j = 0; j < 4; j++) {
+            int index = qMin(latencies.size() - 1, latencies.size() * percentiles[j] / 100);
+
+            out << " p" << percentiles[j] << " " << latencies.at(index) / 1e6 << " ms";
+        }
+
+        out << endl;
+    }
+}
+
+bool EventReplayer::dispatch(const QVariantMap &record, Kind *kind)
+{
+    QString event = record.value("event").toString();
+
+    QPoint pos(record.value("x").toInt(), record.value("y").toInt());
+    Qt::MouseButtons buttons(QFlag(record.value("buttons").toInt()));
+    Qt::KeyboardModifiers modifiers(QFlag(record.value("modifiers").toInt()));
+
+    if (event == "press" || event == "release" || event == "doubleClick" || event == "move") {
+        QEvent::Type type = QEvent::MouseMove;
+
+        if (event == "press") {
+            type = QEvent::MouseButtonPress;
+        } else if (event == "release") {
+            type = QEvent::MouseButtonRelease;
+        } else if (event == "doubleClick") {
+            type = QEvent::MouseButtonDblClick;
+        }
+
+        QMouseEvent mouse(type, pos, m_input->mapToGlobal(pos),
+                          static_cast<Qt::MouseButton>(record.value("button").toInt()),
+                          buttons, modifiers);
+        QCoreApplication::sendEvent(m_input, &mouse);
+
+        *kind = MouseKind;
+        return true;
+    }
+
+    if (event == "wheel") {
+        QWheelEvent wheel(pos, m_input->mapToGlobal(pos), record.value("delta").toInt(),
+                          buttons, modifiers,
+                          static_cast<Qt::Orientation>(record.value("orientation").toInt()));
+        QCoreApplication::sendEvent(m_input, &wheel);
+
+        *kind = WheelKind;
+        return true;
+    }
+
+    if (event == "keyPress" || event == "keyRelease") {
+        QKeyEvent key(event == "keyPress" ? QEvent::KeyPress : QEvent::KeyRelease,
+                      record.value("key").toInt(), modifiers, record.value("text").toString(),
+                      record.value("autoRepeat").toBool());
+        QCoreApplication::sendEvent(m_input, &key);
+
+        *kind = KeyKind;
+        return true;
+    }
+
+    if (event == "resize") {
+        m_input->resize(record.value("width").toInt(), record.value("height").toInt());
+        return false;
+    }
+
+    QString name = record.value("name").toString();
+    QWidget *control = m_controlParent && !name.isEmpty()
+            ? m_controlParent->findChild<QWidget *>(name) : 0;
+
+    if (!control) {
+        return false;
+    }
+
+    *kind = ControlKind;
+
+    if (event == "click") {
+        QAbstractButton *button = qobject_cast<QAbstractButton *>(control);
+
+        if (!button || !button->isEnabled()) {
+            return false;
+        }
+
+        button->click();
+        return true;
+    }
+
+    if (event != "control") {
+        return false;
+    }
+
+    // Changes which leave the control as it is were made by the program in
+    // response to other input, not by the user
+    if (QSpinBox *box = qobject_cast<QSpinBox *>(control)) {
+        int value = record.value("value").toInt();
+
+        if (box->value() == value) {
+            return false;
+        }
+
+        box->setValue(value);
+    } else if (QDoubleSpinBox *box = qobject_cast<QDoubleSpinBox *>(control)) {
+        double value = record.value("value").toDouble();
+
+        if (box->value() == value) {
+            return false;
+        }
+
+        box->setValue(value);
+    } else if (QAbstractSlider *slider = qobject_cast<QAbstractSlider *>(control)) {
+        int value = record.value("value").toInt();
+
+        if (slider->value() == value) {
+            return false;
+        }
+
+        slider->setValue(value);
+    } else if (QComboBox *combo = qobject_cast<QComboBox *>(control)) {
+        int index = record.value("value").toInt();
+
+        if (combo->currentIndex() == index) {
+            return false;
+        }
+
+        combo->setCurrentIndex(index);
+    } else if (QListWidget *list = qobject_cast<QListWidget *>(control)) {
+        int row = record.value("value").toInt();
+
+        if (list->currentRow() == row) {
+            return false;
+        }
+
+        list->setCurrentRow(row);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+void EventReplayer::renderFrame()
+{
+    if (m_input->size().isEmpty()) {
+        return;
+    }
+
+    if (m_frame.size() != m_input->size()) {
+        m_frame = QImage(m_input->size(), QImage::Format_ARGB32_Premultiplied);
+    }
+
+    m_input->render(&m_frame);
+}
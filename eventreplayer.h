@@ -0,0 +1,93 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef EVENTREPLAYER_H
+#define EVENTREPLAYER_H
+
+#include <QObject>
+#include <QVariantMap>
+#include <QVector>
+#include <QImage>
+
+class QWidget;
+
+// Feeds a session written by EventRecorder back to a widget, which does not
+// need to be shown. After every event the pending events are processed and
+// a frame of the widget is rendered offscreen; the time from the event to
+// the end of its frame is its latency.
+//
+// At the recorded speed an event is due at its recorded time and its latency
+// includes any delay caused by the previous ones. At maximum speed events
+// are sent one after another and the latency starts when it is sent.
+class EventReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EventReplayer(QObject *parent = 0);
+
+    bool load(const QString &fileName);
+    QString errorString() const;
+
+    int eventCount() const;
+
+    void setInputWidget(QWidget *widget);
+
+    // Controls are found by object name among the children of the widget
+    void setControlParent(QWidget *widget);
+
+    void setMaximumSpeed(bool maximum);
+    bool maximumSpeed() const;
+
+    // Replays all the events, returns when done
+    void run();
+
+    // Prints latency percentiles of each kind of event to stdout
+    void report() const;
+
+private:
+    enum Kind {
+        MouseKind,
+        WheelKind,
+        KeyKind,
+        ControlKind,
+        KindCount
+    };
+
+    // Sends the event, returns false if it was skipped
+    bool dispatch(const QVariantMap &record, Kind *kind);
+    void renderFrame();
+
+    QList<QVariantMap> m_records;
+    QString m_error;
+
+    QWidget *m_input;
+    QWidget *m_controlParent;
+    bool m_maximumSpeed;
+
+    QImage m_frame;
+
+    // Nanoseconds, for each kind
+    QVector<qint64> m_latencies[KindCount];
+    qint64 m_duration;
+};
+
+#endif // EVENTREPLAYER_H
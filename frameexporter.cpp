@@ -0,0 +1,248 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "frameexporter.h"
+
+#include <QtConcurrentRun>
+#include <QRunnable>
+#include <QPainter>
+#include <QImage>
+#include <QDir>
+
+const int kDefaultQueueDepth = 8;
+
+class FrameRenderTask : public QRunnable
+{
+public:
+    FrameRenderTask(FrameExporter *exporter, int frame)
+        : m_exporter(exporter), m_frame(frame) {}
+
+    void run()
+    {
+        m_exporter->renderFrame(m_frame);
+    }
+
+private:
+    FrameExporter *m_exporter;
+    int m_frame;
+};
+
+class FrameEncodeTask : public QRunnable
+{
+public:
+    FrameEncodeTask(FrameExporter *exporter, int frame, const QImage &image)
+        : m_exporter(exporter), m_frame(frame), m_image(image) {}
+
+    void run()
+    {
+        m_exporter->encodeFrame(m_frame, m_image);
+    }
+
+private:
+    FrameExporter *m_exporter;
+    int m_frame;
+    QImage m_image;
+};
+
+FrameExporter::FrameExporter(QObject *parent) :
+    QObject(parent),
+    m_queueDepth(kDefaultQueueDepth),
+    m_framesWritten(0),
+    m_cancelled(0),
+    m_elapsed(0)
+{
+    connect(&m_watcher, SIGNAL(finished()), SLOT(exportFinished()));
+}
+
+FrameExporter::~FrameExporter()
+{
+    cancel();
+    m_watcher.waitForFinished();
+}
+
+void FrameExporter::setTrack(const AnimationTrack &track)
+{
+    m_track = track;
+}
+
+void FrameExporter::setRenderer(const SceneRenderer &renderer)
+{
+    m_renderer = renderer;
+    m_renderer.setCurrentEmitter(-1);
+}
+
+void FrameExporter::setOutputDirectory(const QString &dir)
+{
+    m_outputDir = dir;
+}
+
+QString FrameExporter::outputDirectory() const
+{
+    return m_outputDir;
+}
+
+void FrameExporter::setQueueDepth(int depth)
+{
+    m_queueDepth = qMax(1, depth);
+}
+
+int FrameExporter::queueDepth() const
+{
+    return m_queueDepth;
+}
+
+int FrameExporter::frameCount() const
+{
+    return m_track.frameCount();
+}
+
+int FrameExporter::framesWritten() const
+{
+    return m_framesWritten;
+}
+
+bool FrameExporter::isRunning() const
+{
+    return m_watcher.isRunning();
+}
+
+bool FrameExporter::wasCancelled() const
+{
+    return m_cancelled != 0;
+}
+
+qreal FrameExporter::framesPerSecond() const
+{
+    if (m_elapsed <= 0) {
+        return 0.0;
+    }
+
+    return framesWritten() * 1000.0 / m_elapsed;
+}
+
+QString FrameExporter::errorString() const
+{
+    QMutexLocker locker(&m_errorMutex);
+    return m_error;
+}
+
+void FrameExporter::start()
+{
+    if (isRunning()) {
+        return;
+    }
+
+    m_framesWritten = 0;
+    m_cancelled = 0;
+    m_elapsed = 0;
+    m_error.clear();
+
+    QDir().mkpath(m_outputDir);
+
+    m_watcher.setFuture(QtConcurrent::run(this, &FrameExporter::run));
+}
+
+void FrameExporter::cancel()
+{
+    m_cancelled = 1;
+}
+
+void FrameExporter::exportFinished()
+{
+    emit finished();
+}
+
+void FrameExporter::run()
+{
+    m_timer.start();
+
+    // Every frame takes a slot before rendering and gives it back once it
+    // is written to disk, which bounds the number of images in memory
+    m_freeSlots.acquire(m_freeSlots.available());
+    m_freeSlots.release(m_queueDepth);
+
+    for (int frame = m_track.firstFrame(); frame <= m_track.lastFrame(); frame++) {
+        m_freeSlots.acquire();
+
+        if (m_cancelled != 0) {
+            m_freeSlots.release();
+            break;
+        }
+
+        m_renderPool.start(new FrameRenderTask(this, frame));
+    }
+
+    m_renderPool.waitForDone();
+    m_encodePool.waitForDone();
+
+    m_elapsed = m_timer.elapsed();
+}
+
+void FrameExporter::renderFrame(int frame)
+{
+    if (m_cancelled != 0) {
+        m_freeSlots.release();
+        return;
+    }
+
+    SceneRenderer renderer = m_renderer;
+    renderer.setFocalLength(m_track.focalLengthAt(frame));
+    renderer.setEmitters(m_track.emittersAt(frame));
+
+    QImage image(renderer.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(QColor(Qt::white).rgb());
+
+    QPainter p(&image);
+    renderer.render(p);
+    p.end();
+
+    m_encodePool.start(new FrameEncodeTask(this, frame, image));
+}
+
+void FrameExporter::encodeFrame(int frame, const QImage &image)
+{
+    if (m_cancelled == 0) {
+        if (image.save(framePath(frame), "PNG")) {
+            emit progress(m_framesWritten.fetchAndAddOrdered(1) + 1);
+        } else {
+            setError(tr("Could not write %1").arg(framePath(frame)));
+            cancel();
+        }
+    }
+
+    m_freeSlots.release();
+}
+
+void FrameExporter::setError(const QString &error)
+{
+    QMutexLocker locker(&m_errorMutex);
+
+    if (m_error.isEmpty()) {
+        m_error = error;
+    }
+}
+
+QString FrameExporter::framePath(int frame) const
+{
+    return QString("%1/frame_%2.png").arg(m_outputDir)
+            .arg(frame - m_track.firstFrame(), 5, 10, QChar('0'));
+}
@@ -0,0 +1,118 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QMutex>
+
+#include "animationtrack.h"
+#include "scenerenderer.h"
+
+// Renders an animation track offscreen and writes it as a numbered PNG
+// sequence (frame_00000.png, frame_00001.png, ...).
+//
+// Frames are rendered on one thread pool and compressed on another, so
+// rendering of the next frames overlaps with encoding of the previous ones.
+// At most queueDepth() frames are held in memory at any time.
+class FrameExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameExporter(QObject *parent = 0);
+    ~FrameExporter();
+
+    void setTrack(const AnimationTrack &track);
+
+    // View (size, offset, scale) used for every frame
+    void setRenderer(const SceneRenderer &renderer);
+
+    void setOutputDirectory(const QString &dir);
+    QString outputDirectory() const;
+
+    // Maximum number of frames being rendered or waiting for encoding
+    void setQueueDepth(int depth);
+    int queueDepth() const;
+
+    int frameCount() const;
+    int framesWritten() const;
+
+    bool isRunning() const;
+    bool wasCancelled() const;
+
+    // Throughput of the last export
+    qreal framesPerSecond() const;
+
+    // Text of the first error occured, empty if none
+    QString errorString() const;
+
+public slots:
+    void start();
+    void cancel();
+
+signals:
+    void progress(int framesWritten);
+    void finished();
+
+private slots:
+    void exportFinished();
+
+private:
+    friend class FrameRenderTask;
+    friend class FrameEncodeTask;
+
+    void run();
+
+    void renderFrame(int frame);
+    void encodeFrame(int frame, const QImage &image);
+    void setError(const QString &error);
+
+    QString framePath(int frame) const;
+
+    AnimationTrack m_track;
+    SceneRenderer m_renderer;
+    QString m_outputDir;
+    int m_queueDepth;
+
+    QThreadPool m_renderPool;
+    QThreadPool m_encodePool;
+    QSemaphore m_freeSlots;
+
+    QAtomicInt m_framesWritten;
+    QAtomicInt m_cancelled;
+
+    mutable QMutex m_errorMutex;
+    QString m_error;
+
+    QElapsedTimer m_timer;
+    qint64 m_elapsed;
+
+    QFutureWatcher<void> m_watcher;
+};
+
+#endif // FRAMEEXPORTER_H
@@ -0,0 +1,239 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "imagemapper.h"
+
+#include <QtConcurrentMap>
+#include <QVector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Fractional bits of sample coordinates
+const int kSubpixelBits = 8;
+const int kSubpixelOne = 1 << kSubpixelBits;
+
+namespace
+{
+
+#ifdef __SSE2__
+// Premultiplied ARGB pixel interpolated between four neighbours, fx and fy
+// are in 1/256 of a pixel
+inline quint32 bilinear(const quint32 *top, const quint32 *bottom, int fx, int fy)
+{
+    int w00 = (kSubpixelOne - fx) * (kSubpixelOne - fy) >> kSubpixelBits;
+    int w10 = fx * (kSubpixelOne - fy) >> kSubpixelBits;
+    int w01 = (kSubpixelOne - fx) * fy >> kSubpixelBits;
+    int w11 = kSubpixelOne - w00 - w10 - w01;
+
+    const __m128i zero = _mm_setzero_si128();
+
+    // Two neighbouring pixels of each row, 16 bits per channel
+    __m128i t = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(top)), zero);
+    __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(bottom)), zero);
+
+    __m128i wt = _mm_set_epi16(w10, w10, w10, w10, w00, w00, w00, w00);
+    __m128i wb = _mm_set_epi16(w11, w11, w11, w11, w01, w01, w01, w01);
+
+    // Weights add up to 256, so the sums fit in 16 bits
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(t, wt), _mm_mullo_epi16(b, wb));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srli_epi16(sum, kSubpixelBits);
+
+    return _mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+}
+#else
+inline quint32 bilinear(const quint32 *top, const quint32 *bottom, int fx, int fy)
+{
+    int w00 = (kSubpixelOne - fx) * (kSubpixelOne - fy) >> kSubpixelBits;
+    int w10 = fx * (kSubpixelOne - fy) >> kSubpixelBits;
+    int w01 = (kSubpixelOne - fx) * fy >> kSubpixelBits;
+    int w11 = kSubpixelOne - w00 - w10 - w01;
+
+    quint32 result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        quint32 c = ((top[0] >> shift) & 0xff) * w00 + ((top[1] >> shift) & 0xff) * w10
+                + ((bottom[0] >> shift) & 0xff) * w01 + ((bottom[1] >> shift) & 0xff) * w11;
+        result |= (c >> kSubpixelBits) << shift;
+    }
+
+    return result;
+}
+#endif
+
+}
+
+class ImageMapperRow
+{
+public:
+    ImageMapperRow(const ImageMapper *mapper, QImage *result)
+        : m_mapper(mapper), m_result(result) {}
+
+    void operator()(const int &row) const
+    {
+        m_mapper->mapRow(row, *m_result);
+    }
+
+private:
+    const ImageMapper *m_mapper;
+    QImage *m_result;
+};
+
+ImageMapper::ImageMapper() :
+    m_focalLength(0.0),
+    m_scale(1.0)
+{
+}
+
+void ImageMapper::setSource(const QImage &image)
+{
+    if (image.format() == QImage::Format_ARGB32_Premultiplied) {
+        m_source = image;
+    } else {
+        m_source = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+}
+
+QImage ImageMapper::source() const
+{
+    return m_source;
+}
+
+void ImageMapper::setObjectRect(const QRectF &rect)
+{
+    m_objectRect = rect.normalized();
+}
+
+QRectF ImageMapper::objectRect() const
+{
+    return m_objectRect;
+}
+
+void ImageMapper::setFocalLength(qreal len)
+{
+    m_focalLength = len;
+}
+
+qreal ImageMapper::focalLength() const
+{
+    return m_focalLength;
+}
+
+void ImageMapper::setView(const QSize &size, const QPointF &topLeft, qreal scale)
+{
+    m_size = size;
+    m_topLeft = topLeft;
+    m_scale = scale;
+}
+
+qreal ImageMapper::magnification(qreal objectX, qreal focalLength)
+{
+    return focalLength / (focalLength + objectX);
+}
+
+QImage ImageMapper::map() const
+{
+    QImage result(m_size, QImage::Format_ARGB32_Premultiplied);
+    result.fill(0);
+
+    if (m_source.width() < 2 || m_source.height() < 2
+            || m_objectRect.isEmpty() || m_focalLength == 0.0) {
+        return result;
+    }
+
+    QVector<int> rows(m_size.height());
+
+    for (int i = 0; i < rows.size(); i++) {
+        rows[i] = i;
+    }
+
+    // Rows are written to separate scanlines, so they need no locking. bits()
+    // is called here once to detach the image before the threads start.
+    result.bits();
+    QtConcurrent::blockingMap(rows, ImageMapperRow(this, &result));
+
+    return result;
+}
+
+void ImageMapper::mapRow(int row, QImage &result) const
+{
+    quint32 *out = reinterpret_cast<quint32 *>(result.scanLine(row));
+
+    const int srcWidth = m_source.width();
+    const int srcHeight = m_source.height();
+    const int srcStride = m_source.bytesPerLine() / 4;
+    const quint32 *src = reinterpret_cast<const quint32 *>(m_source.constBits());
+
+    const qreal f = m_focalLength;
+    const qreal yi = m_topLeft.y() - (row + 0.5) / m_scale;
+
+    // Source pixels per unit of length
+    const qreal sx = srcWidth / m_objectRect.width();
+    const qreal sy = srcHeight / m_objectRect.height();
+
+    // Sample coordinates are kept in [0, size - 1] so that the right and
+    // bottom neighbours exist
+    const int maxX = (srcWidth - 1) << kSubpixelBits;
+    const int maxY = (srcHeight - 1) << kSubpixelBits;
+
+    for (int col = 0; col < m_size.width(); col++) {
+        qreal xi = m_topLeft.x() + (col + 0.5) / m_scale;
+
+        if (xi == f) {
+            continue;
+        }
+
+        // Inverse of xi = f xo / (f + xo), yi = f yo / (f + xo)
+        qreal k = f / (f - xi);
+        qreal xo = xi * k;
+        qreal yo = yi * k;
+
+        qreal srcX = (xo - m_objectRect.left()) * sx - 0.5;
+        qreal srcY = (m_objectRect.bottom() - yo) * sy - 0.5;
+
+        // Near the focal plane k grows without bound, so the range is checked
+        // before the conversion to fixed point. NaN fails the comparisons too.
+        if (!(srcX >= 0 && srcY >= 0 && srcX <= srcWidth - 1 && srcY <= srcHeight - 1)) {
+            continue;
+        }
+
+        int px = qMin(qRound(srcX * kSubpixelOne), maxX);
+        int py = qMin(qRound(srcY * kSubpixelOne), maxY);
+
+        int x0 = qMin(px >> kSubpixelBits, srcWidth - 2);
+        int y0 = qMin(py >> kSubpixelBits, srcHeight - 2);
+
+        const quint32 *top = src + y0 * srcStride + x0;
+
+        quint32 pixel = bilinear(top, top + srcStride,
+                                 px - (x0 << kSubpixelBits), py - (y0 << kSubpixelBits));
+
+        if (xi < 0) {
+            // Virtual image
+            pixel = (pixel >> 1) & 0x7f7f7f7f;
+        }
+
+        out[col] = pixel;
+    }
+}
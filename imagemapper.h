@@ -0,0 +1,73 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef IMAGEMAPPER_H
+#define IMAGEMAPPER_H
+
+#include <QImage>
+#include <QRectF>
+
+// Forms the image of a picture lying in the plane of the scene on the
+// object side of a thin lens. Every pixel of the view is mapped back to the
+// object with the thin lens equation 1/xi - 1/xo = 1/f and the source is
+// sampled there, which gives both real (xi > 0) and virtual (xi < 0)
+// images. Virtual ones are drawn half-transparent.
+class ImageMapper
+{
+public:
+    ImageMapper();
+
+    // Converted to premultiplied ARGB if needed
+    void setSource(const QImage &image);
+    QImage source() const;
+
+    // Position of the picture in cartesian coordinates
+    void setObjectRect(const QRectF &rect);
+    QRectF objectRect() const;
+
+    void setFocalLength(qreal len);
+    qreal focalLength() const;
+
+    // Size of the result, cartesian point at its top left corner and
+    // pixels per unit of length
+    void setView(const QSize &size, const QPointF &topLeft, qreal scale);
+
+    QImage map() const;
+
+    // Transverse magnification xi / xo of a point at objectX
+    static qreal magnification(qreal objectX, qreal focalLength);
+
+private:
+    friend class ImageMapperRow;
+
+    void mapRow(int row, QImage &result) const;
+
+    QImage m_source;
+    QRectF m_objectRect;
+    qreal m_focalLength;
+
+    QSize m_size;
+    QPointF m_topLeft;
+    qreal m_scale;
+};
+
+#endif // IMAGEMAPPER_H
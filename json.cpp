@@ -0,0 +1,355 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "json.h"
+
+#include <QStringList>
+
+namespace
+{
+
+// Deeper documents are rejected instead of exhausting the stack
+const int kMaxDepth = 256;
+
+class JsonReader
+{
+public:
+    JsonReader(const QByteArray &data)
+        : m_data(data), m_pos(0), m_depth(0), m_error(false) {}
+
+    QVariant read()
+    {
+        QVariant value = readValue();
+        skipSpace();
+
+        if (m_pos != m_data.size()) {
+            m_error = true;
+        }
+
+        return m_error ? QVariant() : value;
+    }
+
+    bool hasError() const
+    {
+        return m_error;
+    }
+
+private:
+    void skipSpace()
+    {
+        while (m_pos < m_data.size()) {
+            char c = m_data.at(m_pos);
+
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                break;
+            }
+
+            m_pos++;
+        }
+    }
+
+    bool consume(char c)
+    {
+        skipSpace();
+
+        if (m_pos < m_data.size() && m_data.at(m_pos) == c) {
+            m_pos++;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool consumeWord(const char *word)
+    {
+        int len = qstrlen(word);
+
+        if (m_data.mid(m_pos, len) == word) {
+            m_pos += len;
+            return true;
+        }
+
+        m_error = true;
+        return false;
+    }
+
+    QVariant readValue()
+    {
+        skipSpace();
+
+        if (m_pos >= m_data.size()) {
+            m_error = true;
+            return QVariant();
+        }
+
+        switch (m_data.at(m_pos)) {
+        case '{':
+        case '[': {
+            if (m_depth == kMaxDepth) {
+                m_error = true;
+                return QVariant();
+            }
+
+            m_depth++;
+            QVariant value = m_data.at(m_pos) == '{' ? readObject() : readArray();
+            m_depth--;
+
+            return value;
+        }
+        case '"':
+            return readString();
+        case 't':
+            return consumeWord("true") ? QVariant(true) : QVariant();
+        case 'f':
+            return consumeWord("false") ? QVariant(false) : QVariant();
+        case 'n':
+            consumeWord("null");
+            return QVariant();
+        default:
+            return readNumber();
+        }
+    }
+
+    QVariant readObject()
+    {
+        QVariantMap map;
+        m_pos++;
+
+        if (consume('}')) {
+            return map;
+        }
+
+        do {
+            skipSpace();
+
+            if (m_pos >= m_data.size() || m_data.at(m_pos) != '"') {
+                m_error = true;
+                return QVariant();
+            }
+
+            QString key = readString();
+
+            if (!consume(':')) {
+                m_error = true;
+                return QVariant();
+            }
+
+            map.insert(key, readValue());
+        } while (!m_error && consume(','));
+
+        if (!consume('}')) {
+            m_error = true;
+        }
+
+        return map;
+    }
+
+    QVariant readArray()
+    {
+        QVariantList list;
+        m_pos++;
+
+        if (consume(']')) {
+            return list;
+        }
+
+        do {
+            list.append(readValue());
+        } while (!m_error && consume(','));
+
+        if (!consume(']')) {
+            m_error = true;
+        }
+
+        return list;
+    }
+
+    QString readString()
+    {
+        QByteArray utf8;
+        m_pos++;
+
+        while (m_pos < m_data.size()) {
+            char c = m_data.at(m_pos++);
+
+            if (c == '"') {
+                return QString::fromUtf8(utf8);
+            }
+
+            if (c != '\\') {
+                utf8.append(c);
+                continue;
+            }
+
+            if (m_pos >= m_data.size()) {
+                break;
+            }
+
+            c = m_data.at(m_pos++);
+
+            switch (c) {
+            case 'b': utf8.append('\b'); break;
+            case 'f': utf8.append('\f'); break;
+            case 'n': utf8.append('\n'); break;
+            case 'r': utf8.append('\r'); break;
+            case 't': utf8.append('\t'); break;
+            case 'u': {
+                bool ok;
+                ushort code = m_data.mid(m_pos, 4).toUShort(&ok, 16);
+
+                if (!ok) {
+                    m_error = true;
+                    return QString();
+                }
+
+                utf8.append(QString(QChar(code)).toUtf8());
+                m_pos += 4;
+                break;
+            }
+            default:
+                utf8.append(c);
+            }
+        }
+
+        m_error = true;
+        return QString();
+    }
+
+    QVariant readNumber()
+    {
+        int start = m_pos;
+
+        while (m_pos < m_data.size()) {
+            char c = m_data.at(m_pos);
+
+            if ((c < '0' || c > '9') && c != '-' && c != '+'
+                    && c != '.' && c != 'e' && c != 'E') {
+                break;
+            }
+
+            m_pos++;
+        }
+
+        bool ok;
+        double value = m_data.mid(start, m_pos - start).toDouble(&ok);
+
+        if (!ok) {
+            m_error = true;
+            return QVariant();
+        }
+
+        return value;
+    }
+
+    const QByteArray &m_data;
+    int m_pos;
+    int m_depth;
+    bool m_error;
+};
+
+QByteArray serializeString(const QString &str)
+{
+    QByteArray result("\"");
+    QByteArray utf8 = str.toUtf8();
+
+    for (int i = 0; i < utf8.size(); i++) {
+        char c = utf8.at(i);
+
+        switch (c) {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if (static_cast<uchar>(c) < 0x20) {
+                result += "\\u" + QByteArray::number(static_cast<uchar>(c), 16)
+                        .rightJustified(4, '0');
+            } else {
+                result += c;
+            }
+        }
+    }
+
+    return result + '"';
+}
+
+}
+
+QVariant Json::parse(const QByteArray &data, bool *ok)
+{
+    JsonReader reader(data);
+    QVariant value = reader.read();
+
+    if (ok) {
+        *ok = !reader.hasError();
+    }
+
+    return value;
+}
+
+QByteArray Json::serialize(const QVariant &value)
+{
+    switch (value.type()) {
+    case QVariant::Invalid:
+        return "null";
+    case QVariant::Bool:
+        return value.toBool() ? "true" : "false";
+    case QVariant::Int:
+    case QVariant::LongLong:
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        return QByteArray::number(value.toLongLong());
+    case QVariant::Double:
+        return QByteArray::number(value.toDouble(), 'g', 17);
+    case QVariant::Map: {
+        QVariantMap map = value.toMap();
+        QByteArray result("{");
+
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            if (it != map.constBegin()) {
+                result += ',';
+            }
+
+            result += serializeString(it.key()) + ':' + serialize(it.value());
+        }
+
+        return result + '}';
+    }
+    case QVariant::List: {
+        QVariantList list = value.toList();
+        QByteArray result("[");
+
+        for (int i = 0; i < list.size(); i++) {
+            if (i > 0) {
+                result += ',';
+            }
+
+            result += serialize(list.at(i));
+        }
+
+        return result + ']';
+    }
+    default:
+        return serializeString(value.toString());
+    }
+}
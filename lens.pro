@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network
 
 TARGET = lens
 TEMPLATE = app
@@ -14,11 +14,47 @@ QMAKE_CXXFLAGS += -Wall -Wextra -Wold-style-cast -pedantic
 SOURCES += main.cpp\
         mainwindow.cpp \
     renderwidget.cpp \
-    rayemitter.cpp
+    rayemitter.cpp \
+    scenerenderer.cpp \
+    animationtrack.cpp \
+    frameexporter.cpp \
+    raytracer.cpp \
+    json.cpp \
+    traceserver.cpp \
+    tracebenchmark.cpp \
+    thicklens.cpp \
+    spectrum.cpp \
+    spectraltracer.cpp \
+    imagemapper.cpp \
+    emittergroup.cpp \
+    editjournal.cpp \
+    editcommands.cpp \
+    raysegmentindex.cpp \
+    lensoptimizer.cpp \
+    eventrecorder.cpp \
+    eventreplayer.cpp
 
 HEADERS  += mainwindow.h \
     renderwidget.h \
-    rayemitter.h
+    rayemitter.h \
+    scenerenderer.h \
+    animationtrack.h \
+    frameexporter.h \
+    raytracer.h \
+    json.h \
+    traceserver.h \
+    tracebenchmark.h \
+    thicklens.h \
+    spectrum.h \
+    spectraltracer.h \
+    imagemapper.h \
+    emittergroup.h \
+    editjournal.h \
+    editcommands.h \
+    raysegmentindex.h \
+    lensoptimizer.h \
+    eventrecorder.h \
+    eventreplayer.h
 
 FORMS    += mainwindow.ui
 
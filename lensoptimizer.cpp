@@ -0,0 +1,496 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "lensoptimizer.h"
+
+#include <QtConcurrentRun>
+#include <QtConcurrentMap>
+
+#include <cmath>
+#include <limits>
+
+const int kDefaultMaxIterations = 200;
+
+// Rays traced by one task. Not more than one chunk of traceThickLens, so
+// that it runs on the task's own thread.
+const int kEvaluationChunkSize = 16384;
+
+// Rays which do not reach the target plane count as landing this far away
+const qreal kMissDistance = 1000.0;
+
+// Thick lens surfaces flatter than this radius are not tried
+const qreal kMinRadius = 1.0;
+
+// Nor thin lenses stronger than this focal length
+const qreal kMinFocalLength = 1.0;
+
+// Size of the starting simplex relative to the parameters
+const qreal kInitialStep = 0.1;
+
+// Stop once the values of the simplex differ less than this
+const qreal kTolerance = 1e-9;
+
+// Nelder-Mead coefficients
+const qreal kReflection = 1.0;
+const qreal kExpansion = 2.0;
+const qreal kContraction = 0.5;
+const qreal kShrink = 0.5;
+
+namespace {
+
+// Sums over the rays first .. end - 1 for one candidate lens
+struct EvaluationTask
+{
+    int candidate;
+    int begin;
+    int end;
+
+    // Of the distances from the target point
+    double sum;
+    double squares;
+
+    int passed;
+};
+
+class EvaluationKernel
+{
+public:
+    EvaluationKernel(const RayBatch *rays, const QVector<qreal> *focalLengths,
+                     const QVector<ThickLens> *lenses, const QPointF &target)
+        : m_rays(rays), m_focalLengths(focalLengths), m_lenses(lenses),
+          m_target(target) {}
+
+    void operator()(EvaluationTask &task) const
+    {
+        task.sum = 0.0;
+        task.squares = 0.0;
+        task.passed = 0;
+
+        if (m_lenses->isEmpty()) {
+            traceThin(task);
+        } else {
+            traceThick(task);
+        }
+    }
+
+private:
+    void add(EvaluationTask &task, qreal y) const
+    {
+        qreal d = y - m_target.y();
+
+        task.sum += d;
+        task.squares += d * d;
+        task.passed++;
+    }
+
+    void traceThin(EvaluationTask &task) const
+    {
+        qreal focalLength = m_focalLengths->at(task.candidate);
+        qreal planeX = m_target.x();
+
+        for (int i = task.begin; i < task.end; i++) {
+            qreal dx = m_rays->dx.at(i);
+
+            if (dx <= 0.0) {
+                continue;
+            }
+
+            qreal slope = m_rays->dy.at(i) / dx;
+            qreal lensY = m_rays->y.at(i) - slope * m_rays->x.at(i);
+
+            add(task, lensY + (slope - lensY / focalLength) * planeX);
+        }
+    }
+
+    void traceThick(EvaluationTask &task) const
+    {
+        int count = task.end - task.begin;
+
+        RayBatch rays;
+        rays.x = m_rays->x.mid(task.begin, count);
+        rays.y = m_rays->y.mid(task.begin, count);
+        rays.dx = m_rays->dx.mid(task.begin, count);
+        rays.dy = m_rays->dy.mid(task.begin, count);
+
+        ThickLensTraceBatch trace;
+        traceThickLens(m_lenses->at(task.candidate), rays, trace);
+
+        for (int i = 0; i < count; i++) {
+            qreal dx = trace.dx2.at(i);
+
+            if (trace.status.at(i) != ThickLensTraceBatch::Passed || dx <= 0.0) {
+                continue;
+            }
+
+            add(task, trace.y2.at(i) + trace.dy2.at(i) * (m_target.x() - trace.x2.at(i)) / dx);
+        }
+    }
+
+    const RayBatch *m_rays;
+    const QVector<qreal> *m_focalLengths;
+    const QVector<ThickLens> *m_lenses;
+    QPointF m_target;
+};
+
+// a + k * (b - a)
+QVector<qreal> along(const QVector<qreal> &a, const QVector<qreal> &b, qreal k)
+{
+    QVector<qreal> result(a.size());
+
+    for (int i = 0; i < a.size(); i++) {
+        result[i] = a.at(i) + k * (b.at(i) - a.at(i));
+    }
+
+    return result;
+}
+
+}
+
+LensOptimizer::LensOptimizer(QObject *parent) :
+    QObject(parent),
+    m_thin(true),
+    m_focalLength(0.0),
+    m_objective(SpotSize),
+    m_maxIterations(kDefaultMaxIterations),
+    m_minParameter(-std::numeric_limits<qreal>::max()),
+    m_maxParameter(std::numeric_limits<qreal>::max()),
+    m_cancelled(0),
+    m_bestValue(0.0)
+{
+    connect(&m_watcher, SIGNAL(finished()), SLOT(optimizationFinished()));
+}
+
+LensOptimizer::~LensOptimizer()
+{
+    cancel();
+    m_watcher.waitForFinished();
+}
+
+void LensOptimizer::setScene(const SceneRenderer &scene)
+{
+    m_rays.resize(0);
+    scene.rayBatch(0, scene.rayCount(), m_rays);
+
+    m_thin = scene.lensMode() == SceneRenderer::ThinLensMode;
+    m_focalLength = scene.focalLength();
+    m_thickLens = scene.thickLens();
+
+    setBest(paramsOf(scene), std::numeric_limits<qreal>::max());
+}
+
+LensOptimizer::Objective LensOptimizer::objective() const
+{
+    return m_objective;
+}
+
+void LensOptimizer::setObjective(Objective objective)
+{
+    m_objective = objective;
+}
+
+QPointF LensOptimizer::target() const
+{
+    return m_target;
+}
+
+void LensOptimizer::setTarget(const QPointF &target)
+{
+    m_target = target;
+}
+
+int LensOptimizer::maxIterations() const
+{
+    return m_maxIterations;
+}
+
+void LensOptimizer::setMaxIterations(int iterations)
+{
+    m_maxIterations = qMax(1, iterations);
+}
+
+void LensOptimizer::setParameterRange(qreal minimum, qreal maximum)
+{
+    m_minParameter = minimum;
+    m_maxParameter = maximum;
+}
+
+bool LensOptimizer::isRunning() const
+{
+    return m_watcher.isRunning();
+}
+
+bool LensOptimizer::wasCancelled() const
+{
+    return m_cancelled != 0;
+}
+
+qreal LensOptimizer::bestFocalLength() const
+{
+    QMutexLocker locker(&m_bestMutex);
+    return m_thin ? m_best.at(0) : m_focalLength;
+}
+
+ThickLens LensOptimizer::bestThickLens() const
+{
+    QMutexLocker locker(&m_bestMutex);
+    return m_thin ? m_thickLens : thickLensFor(m_best);
+}
+
+qreal LensOptimizer::bestValue() const
+{
+    QMutexLocker locker(&m_bestMutex);
+    return m_bestValue;
+}
+
+qreal LensOptimizer::valueFor(const SceneRenderer &scene) const
+{
+    QVector<QVector<qreal> > points;
+    points << paramsOf(scene);
+
+    return evaluate(points).first();
+}
+
+void LensOptimizer::start()
+{
+    if (isRunning()) {
+        return;
+    }
+
+    m_cancelled = 0;
+    m_watcher.setFuture(QtConcurrent::run(this, &LensOptimizer::run));
+}
+
+void LensOptimizer::cancel()
+{
+    m_cancelled = 1;
+}
+
+void LensOptimizer::optimizationFinished()
+{
+    emit finished();
+}
+
+void LensOptimizer::run()
+{
+    int n = m_best.size();
+
+    // Starting simplex around the current lens
+    QVector<QVector<qreal> > simplex;
+    simplex << m_best;
+
+    for (int i = 0; i < n; i++) {
+        QVector<qreal> vertex = m_best;
+        vertex[i] += vertex.at(i) == 0.0 ? kInitialStep : kInitialStep * vertex.at(i);
+        simplex << vertex;
+    }
+
+    QVector<qreal> values = evaluate(simplex);
+
+    for (int iteration = 1; iteration <= m_maxIterations && m_cancelled == 0; iteration++) {
+        // Best vertex first, worst last
+        for (int i = 1; i <= n; i++) {
+            for (int j = i; j > 0 && values.at(j) < values.at(j - 1); j--) {
+                qSwap(values[j], values[j - 1]);
+                qSwap(simplex[j], simplex[j - 1]);
+            }
+        }
+
+        setBest(simplex.first(), values.first());
+        emit progress(iteration, values.first());
+
+        if (values.last() - values.first() <= kTolerance * (qAbs(values.first()) + kTolerance)) {
+            break;
+        }
+
+        QVector<qreal> centroid(n, 0.0);
+
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                centroid[j] += simplex.at(i).at(j) / n;
+            }
+        }
+
+        const QVector<qreal> &worst = simplex.last();
+
+        // All the points the step may need, traced together
+        QVector<QVector<qreal> > candidates;
+        candidates << along(centroid, worst, -kReflection)
+                   << along(centroid, worst, -kExpansion)
+                   << along(centroid, worst, -kReflection * kContraction)
+                   << along(centroid, worst, kContraction);
+
+        QVector<qreal> candidateValues = evaluate(candidates);
+
+        qreal reflected = candidateValues.at(0);
+        int replacement = -1;
+
+        if (reflected < values.first()) {
+            replacement = candidateValues.at(1) < reflected ? 1 : 0;
+        } else if (reflected < values.at(n - 1)) {
+            replacement = 0;
+        } else if (reflected < values.last()) {
+            replacement = candidateValues.at(2) <= reflected ? 2 : -1;
+        } else {
+            replacement = candidateValues.at(3) < values.last() ? 3 : -1;
+        }
+
+        if (replacement != -1) {
+            simplex.last() = candidates.at(replacement);
+            values.last() = candidateValues.at(replacement);
+            continue;
+        }
+
+        // Shrink towards the best vertex
+        QVector<QVector<qreal> > shrunk;
+
+        for (int i = 1; i <= n; i++) {
+            simplex[i] = along(simplex.first(), simplex.at(i), kShrink);
+            shrunk << simplex.at(i);
+        }
+
+        QVector<qreal> shrunkValues = evaluate(shrunk);
+
+        for (int i = 1; i <= n; i++) {
+            values[i] = shrunkValues.at(i - 1);
+        }
+    }
+
+    // The last step may have found a better vertex
+    for (int i = 0; i <= n; i++) {
+        if (values.at(i) < bestValue()) {
+            setBest(simplex.at(i), values.at(i));
+        }
+    }
+}
+
+QVector<qreal> LensOptimizer::evaluate(const QVector<QVector<qreal> > &points) const
+{
+    QVector<qreal> focalLengths;
+    QVector<ThickLens> lenses;
+    QVector<EvaluationTask> tasks;
+
+    for (int i = 0; i < points.size(); i++) {
+        if (m_thin) {
+            focalLengths << points.at(i).at(0);
+        } else {
+            lenses << thickLensFor(points.at(i));
+        }
+
+        // Invalid lenses are not traced at all
+        if (!isValid(points.at(i))) {
+            continue;
+        }
+
+        for (int begin = 0; begin < m_rays.size(); begin += kEvaluationChunkSize) {
+            EvaluationTask task;
+            task.candidate = i;
+            task.begin = begin;
+            task.end = qMin(m_rays.size(), begin + kEvaluationChunkSize);
+            tasks << task;
+        }
+    }
+
+    QtConcurrent::blockingMap(tasks, EvaluationKernel(&m_rays, &focalLengths, &lenses,
+                                                      m_target));
+
+    QVector<double> sums(points.size(), 0.0);
+    QVector<double> squares(points.size(), 0.0);
+    QVector<int> passed(points.size(), 0);
+
+    for (int i = 0; i < tasks.size(); i++) {
+        const EvaluationTask &task = tasks.at(i);
+
+        sums[task.candidate] += task.sum;
+        squares[task.candidate] += task.squares;
+        passed[task.candidate] += task.passed;
+    }
+
+    QVector<qreal> values(points.size());
+
+    for (int i = 0; i < points.size(); i++) {
+        if (!isValid(points.at(i))) {
+            values[i] = std::numeric_limits<qreal>::max();
+            continue;
+        }
+
+        int total = m_rays.size();
+
+        if (total == 0) {
+            values[i] = 0.0;
+            continue;
+        }
+
+        double deviation = squares.at(i);
+
+        // Spread around the centroid instead of the target point
+        if (m_objective == SpotSize && passed.at(i) > 0) {
+            deviation -= sums.at(i) * sums.at(i) / passed.at(i);
+        }
+
+        deviation += (total - passed.at(i)) * kMissDistance * kMissDistance;
+        values[i] = std::sqrt(qMax(0.0, deviation) / total);
+    }
+
+    return values;
+}
+
+QVector<qreal> LensOptimizer::paramsOf(const SceneRenderer &scene) const
+{
+    QVector<qreal> params;
+
+    if (m_thin) {
+        params << scene.focalLength();
+    } else {
+        params << scene.thickLens().frontRadius() << scene.thickLens().backRadius();
+    }
+
+    return params;
+}
+
+bool LensOptimizer::isValid(const QVector<qreal> &params) const
+{
+    for (int i = 0; i < params.size(); i++) {
+        if (!(params.at(i) >= m_minParameter && params.at(i) <= m_maxParameter)) {
+            return false;
+        }
+    }
+
+    if (m_thin) {
+        return qAbs(params.at(0)) >= kMinFocalLength;
+    }
+
+    return qAbs(params.at(0)) >= kMinRadius && qAbs(params.at(1)) >= kMinRadius;
+}
+
+ThickLens LensOptimizer::thickLensFor(const QVector<qreal> &params) const
+{
+    return ThickLens(params.at(0), params.at(1), m_thickLens.thickness(),
+                     m_thickLens.refractiveIndex());
+}
+
+void LensOptimizer::setBest(const QVector<qreal> &params, qreal value)
+{
+    QMutexLocker locker(&m_bestMutex);
+
+    m_best = params;
+    m_bestValue = value;
+}
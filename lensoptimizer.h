@@ -0,0 +1,128 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef LENSOPTIMIZER_H
+#define LENSOPTIMIZER_H
+
+#include <QObject>
+#include <QVector>
+#include <QPointF>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QMutex>
+
+#include "scenerenderer.h"
+#include "thicklens.h"
+
+// Searches the lens which brings the rays of a scene closest to a target,
+// with the Nelder-Mead simplex method. The thin lens has its focal length
+// optimized, the thick lens its two radii.
+//
+// Every iteration evaluates the reflected, expanded and both contracted
+// points at once; each evaluation traces all the rays of the scene, split
+// into chunks traced in parallel.
+class LensOptimizer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Objective {
+        // RMS distance of the rays from their centroid on the target plane
+        SpotSize,
+        // RMS distance of the rays from the target point
+        TargetDistance
+    };
+
+    explicit LensOptimizer(QObject *parent = 0);
+    ~LensOptimizer();
+
+    // Rays and the starting lens. The lens mode selects the parameters.
+    void setScene(const SceneRenderer &scene);
+
+    Objective objective() const;
+    void setObjective(Objective objective);
+
+    // Its x is the target plane
+    QPointF target() const;
+    void setTarget(const QPointF &target);
+
+    int maxIterations() const;
+    void setMaxIterations(int iterations);
+
+    // Focal lengths or radii outside of the range are not tried, e.g. those
+    // the controls can not show
+    void setParameterRange(qreal minimum, qreal maximum);
+
+    bool isRunning() const;
+    bool wasCancelled() const;
+
+    // Best lens found so far and its objective value
+    qreal bestFocalLength() const;
+    ThickLens bestThickLens() const;
+    qreal bestValue() const;
+
+    // Objective value of the scene's lens for the rays given to setScene()
+    qreal valueFor(const SceneRenderer &scene) const;
+
+public slots:
+    void start();
+    void cancel();
+
+signals:
+    void progress(int iteration, double bestValue);
+    void finished();
+
+private slots:
+    void optimizationFinished();
+
+private:
+    void run();
+
+    // Objective values of the parameter vectors
+    QVector<qreal> evaluate(const QVector<QVector<qreal> > &points) const;
+
+    QVector<qreal> paramsOf(const SceneRenderer &scene) const;
+    bool isValid(const QVector<qreal> &params) const;
+    ThickLens thickLensFor(const QVector<qreal> &params) const;
+
+    void setBest(const QVector<qreal> &params, qreal value);
+
+    RayBatch m_rays;
+    bool m_thin;
+    qreal m_focalLength;
+    ThickLens m_thickLens;
+
+    Objective m_objective;
+    QPointF m_target;
+    int m_maxIterations;
+    qreal m_minParameter;
+    qreal m_maxParameter;
+
+    QAtomicInt m_cancelled;
+
+    mutable QMutex m_bestMutex;
+    QVector<qreal> m_best;
+    qreal m_bestValue;
+
+    QFutureWatcher<void> m_watcher;
+};
+
+#endif // LENSOPTIMIZER_H
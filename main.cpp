@@ -21,10 +21,157 @@
 */
 
 #include <QtGui/QApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
 #include "mainwindow.h"
+#include "traceserver.h"
+#include "tracebenchmark.h"
+#include "eventrecorder.h"
+#include "eventreplayer.h"
+
+const char *const kDefaultServerName = "lens-trace";
+
+static bool hasOption(int argc, char *argv[], const char *option)
+{
+    for (int i = 1; i < argc; i++) {
+        if (qstrcmp(argv[i], option) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Value following the option, or defaultValue if there is none
+static QString optionValue(const QStringList &args, const QString &option,
+                           const QString &defaultValue)
+{
+    int index = args.indexOf(option);
+
+    if (index == -1 || index + 1 >= args.size()) {
+        return defaultValue;
+    }
+
+    return args.at(index + 1);
+}
+
+static int runTraceServer(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+
+    QString name = optionValue(args, "--trace-server", kDefaultServerName);
+
+    if (name.startsWith("--")) {
+        name = kDefaultServerName;
+    }
+
+    TraceServer server;
+    server.setMaxThreadCount(optionValue(args, "--threads",
+                                         QString::number(QThread::idealThreadCount())).toInt());
+
+    if (!server.listen(name)) {
+        QTextStream(stderr) << "Could not listen on " << name << ": "
+                            << server.errorString() << endl;
+        return 1;
+    }
+
+    QTextStream(stderr) << "Listening on " << name << endl;
+
+    return a.exec();
+}
+
+static int runTraceBenchmark(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+
+    QString name = optionValue(args, "--trace-bench", kDefaultServerName);
+
+    if (name.startsWith("--")) {
+        name = kDefaultServerName;
+    }
+
+    TraceBenchmark bench;
+    bench.setServerName(name);
+    bench.setRayCount(optionValue(args, "--rays", "10000").toInt());
+    bench.setRequestCount(optionValue(args, "--requests", "1000").toInt());
+    bench.setPipelineDepth(optionValue(args, "--depth", "8").toInt());
+    bench.setBinary(args.contains("--binary"));
+
+    QObject::connect(&bench, SIGNAL(finished(int)), &a, SLOT(exit(int)));
+    QMetaObject::invokeMethod(&bench, "start", Qt::QueuedConnection);
+
+    return a.exec();
+}
+
+static int runRecorder(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    QString fileName = optionValue(a.arguments(), "--record", QString());
+
+    MainWindow w;
+    EventRecorder recorder;
+    w.recordInput(&recorder);
+
+    if (fileName.isEmpty() || !recorder.start(fileName)) {
+        QTextStream(stderr) << "Could not record to " << fileName << ": "
+                            << recorder.errorString() << endl;
+        return 1;
+    }
+
+    w.show();
+
+    return a.exec();
+}
+
+// Replays a recorded session into a window which is never shown
+static int runReplayer(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    QStringList args = a.arguments();
+    QString fileName = optionValue(args, "--replay", QString());
+
+    EventReplayer replayer;
+
+    if (fileName.isEmpty() || !replayer.load(fileName)) {
+        QTextStream(stderr) << "Could not replay " << fileName << ": "
+                            << replayer.errorString() << endl;
+        return 1;
+    }
+
+    MainWindow w;
+
+    replayer.setInputWidget(w.findChild<QWidget *>("plotArea"));
+    replayer.setControlParent(&w);
+    replayer.setMaximumSpeed(args.contains("--max-speed"));
+
+    replayer.run();
+    replayer.report();
+
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
+    if (hasOption(argc, argv, "--trace-server")) {
+        return runTraceServer(argc, argv);
+    }
+
+    if (hasOption(argc, argv, "--trace-bench")) {
+        return runTraceBenchmark(argc, argv);
+    }
+
+    if (hasOption(argc, argv, "--record")) {
+        return runRecorder(argc, argv);
+    }
+
+    if (hasOption(argc, argv, "--replay")) {
+        return runReplayer(argc, argv);
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
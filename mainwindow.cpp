@@ -24,13 +24,50 @@
 #include "ui_mainwindow.h"
 
 #include "rayemitter.h"
+#include "frameexporter.h"
+#include "imagemapper.h"
+#include "editjournal.h"
+#include "lensoptimizer.h"
+#include "eventrecorder.h"
 
 #include <qmath.h>
 #include <QDebug>
+#include <QAbstractSlider>
+#include <QComboBox>
+#include <QFile>
+#include <QFileDialog>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QRegExp>
+#include <QTextStream>
+
+const int kKeyframeStep = 30;
+
+// Shape of a new emitter group
+const qreal kGroupSpread = 20.0;
+const qreal kGroupSpacing = 1.0;
+
+// Sellmeier coefficients of the glasses in dispersionBox
+const qreal kBk7B[3] = { 1.03961212, 0.231792344, 1.01046945 };
+const qreal kBk7C[3] = { 0.00600069867, 0.0200179144, 103.560653 };
+const qreal kSf11B[3] = { 1.73759695, 0.313747346, 1.89878101 };
+const qreal kSf11C[3] = { 0.013188707, 0.0623068142, 155.23629 };
+
+enum DispersionItem {
+    NoDispersionItem,
+    AbbeNumberItem,
+    Bk7Item,
+    Sf11Item
+};
 
 MainWindow::MainWindow(QWidget *parent) :
     QWidget(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    m_exporter(0),
+    m_exportProgress(0),
+    m_optimizer(0),
+    m_optimizeProgress(0)
 {
     ui->setupUi(this);
 
@@ -44,22 +81,99 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->focalLengthBox, SIGNAL(valueChanged(int)), ui->plotArea,
             SLOT(lensFocalLengthChanged(int)));
 
+    connect(ui->lensModeBox, SIGNAL(currentIndexChanged(int)), ui->plotArea,
+            SLOT(setLensMode(int)));
+    connect(ui->lensModeBox, SIGNAL(currentIndexChanged(int)),
+            SLOT(lensModeChanged(int)));
+
+    connect(ui->frontRadiusBox, SIGNAL(valueChanged(double)), SLOT(thickLensChanged()));
+    connect(ui->backRadiusBox, SIGNAL(valueChanged(double)), SLOT(thickLensChanged()));
+    connect(ui->thicknessBox, SIGNAL(valueChanged(double)), SLOT(thickLensChanged()));
+    connect(ui->refractiveIndexBox, SIGNAL(valueChanged(double)), SLOT(thickLensChanged()));
+    connect(ui->plotArea, SIGNAL(thickLensChanged(ThickLens)),
+            SLOT(showThickLens(ThickLens)));
+
+    connect(ui->dispersionBox, SIGNAL(currentIndexChanged(int)), SLOT(dispersionChanged()));
+    connect(ui->abbeNumberBox, SIGNAL(valueChanged(double)), SLOT(dispersionChanged()));
+
+    connect(ui->wavelengthsBox, SIGNAL(valueChanged(int)), ui->plotArea,
+            SLOT(emitterWavelengthsChanged(int)));
+
     connect(ui->sourceAngleSlider, SIGNAL(valueChanged(int)),
             SLOT(angleChanged(int)));
     connect(ui->sourceAngleBox, SIGNAL(valueChanged(double)),
             SLOT(angleChanged(double)));
 
+    // Each use of a control is a separate undo step
+    connect(ui->sourceXBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->sourceYBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->sourceAngleBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->sourceAngleSlider, SIGNAL(sliderReleased()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->wavelengthsBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->focalLengthBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->frontRadiusBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->backRadiusBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->thicknessBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+    connect(ui->refractiveIndexBox, SIGNAL(editingFinished()), ui->plotArea, SLOT(beginEdit()));
+
     connect(ui->emittersList, SIGNAL(currentRowChanged(int)), ui->plotArea,
             SLOT(setCurrentEmitter(int)));
 
     connect(ui->deleteEmitterButton, SIGNAL(clicked()), SLOT(deleteEmitter()));
     connect(ui->addEmitterButton, SIGNAL(clicked()), SLOT(addEmitter()));
+    connect(ui->importEmittersButton, SIGNAL(clicked()), SLOT(importEmitters()));
+
+    connect(ui->plotArea, SIGNAL(emittersInserted(int,int)),
+            SLOT(emittersInserted(int,int)));
+    connect(ui->plotArea, SIGNAL(emittersRemoved(int,int)),
+            SLOT(emittersRemoved(int,int)));
+
+    connect(ui->plotArea, SIGNAL(focalLengthChanged(int)), ui->focalLengthBox,
+            SLOT(setValue(int)));
+
+    EditJournal *journal = ui->plotArea->journal();
+
+    connect(ui->undoButton, SIGNAL(clicked()), journal, SLOT(undo()));
+    connect(ui->redoButton, SIGNAL(clicked()), journal, SLOT(redo()));
+    connect(journal, SIGNAL(canUndoChanged(bool)), ui->undoButton, SLOT(setEnabled(bool)));
+    connect(journal, SIGNAL(canRedoChanged(bool)), ui->redoButton, SLOT(setEnabled(bool)));
+
+    connect(ui->loadObjectButton, SIGNAL(clicked()), SLOT(loadObject()));
+    connect(ui->clearObjectButton, SIGNAL(clicked()), SLOT(clearObject()));
+
+    connect(ui->plotArea, SIGNAL(objectMoved()), SLOT(updateMagnification()));
+    connect(ui->plotArea, SIGNAL(apertureChanged(ApertureStatistics)),
+            SLOT(apertureChanged(ApertureStatistics)));
+    connect(ui->plotArea, SIGNAL(focalLengthChanged(int)), SLOT(updateMagnification()));
+    connect(ui->lensModeBox, SIGNAL(currentIndexChanged(int)), SLOT(updateMagnification()));
+
+    connect(ui->addKeyframeButton, SIGNAL(clicked()), SLOT(addKeyframe()));
+    connect(ui->exportButton, SIGNAL(clicked()), SLOT(exportAnimation()));
+    connect(ui->optimizeButton, SIGNAL(clicked()), SLOT(optimizeLens()));
 
     connect(ui->plotArea, SIGNAL(currentEmitterChanged(int)), SLOT(currentEmitterChanged(int)));
 
+    connect(ui->groupsList, SIGNAL(currentRowChanged(int)), ui->plotArea,
+            SLOT(setCurrentGroup(int)));
+    connect(ui->plotArea, SIGNAL(currentGroupChanged(int)), SLOT(currentGroupChanged(int)));
+
+    connect(ui->addGroupButton, SIGNAL(clicked()), SLOT(addGroup()));
+    connect(ui->deleteGroupButton, SIGNAL(clicked()), SLOT(deleteGroup()));
+
+    connect(ui->plotArea, SIGNAL(groupInserted(int)), SLOT(groupInserted(int)));
+    connect(ui->plotArea, SIGNAL(groupRemoved(int)), SLOT(groupRemoved(int)));
+
     setControlsActive(false);
 
     ui->plotArea->setLensFocalLength(ui->focalLengthBox->value());
+
+    ui->plotArea->setThickLens(thickLensFromBoxes());
+    dispersionChanged();
+    lensModeChanged(ui->lensModeBox->currentIndex());
+
+    ui->clearObjectButton->setEnabled(false);
+    ui->undoButton->setEnabled(false);
+    ui->redoButton->setEnabled(false);
 }
 
 MainWindow::~MainWindow()
@@ -67,6 +181,42 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::recordInput(EventRecorder *recorder)
+{
+    recorder->setInputWidget(ui->plotArea);
+
+    QList<QAbstractSpinBox *> boxes = findChildren<QAbstractSpinBox *>();
+
+    for (int i = 0; i < boxes.size(); i++) {
+        recorder->addControl(boxes.at(i));
+    }
+
+    QList<QAbstractSlider *> sliders = findChildren<QAbstractSlider *>();
+
+    for (int i = 0; i < sliders.size(); i++) {
+        recorder->addControl(sliders.at(i));
+    }
+
+    QList<QComboBox *> combos = findChildren<QComboBox *>();
+
+    for (int i = 0; i < combos.size(); i++) {
+        recorder->addControl(combos.at(i));
+    }
+
+    // Only the buttons which do not open a dialog, so that the session can
+    // be replayed unattended
+    recorder->addControl(ui->addEmitterButton);
+    recorder->addControl(ui->deleteEmitterButton);
+    recorder->addControl(ui->deleteGroupButton);
+    recorder->addControl(ui->undoButton);
+    recorder->addControl(ui->redoButton);
+    recorder->addControl(ui->clearObjectButton);
+
+    // The selected emitter or group is the one the controls edit
+    recorder->addControl(ui->emittersList);
+    recorder->addControl(ui->groupsList);
+}
+
 void MainWindow::currentEmitterChanged(int index)
 {
     if (index != -1) {
@@ -75,6 +225,7 @@ void MainWindow::currentEmitterChanged(int index)
         ui->sourceAngleBox->setValue(emitter.angle() * 180.0 / M_PI);
         ui->sourceXBox->setValue(emitter.pos().x());
         ui->sourceYBox->setValue(emitter.pos().y());
+        ui->wavelengthsBox->setValue(emitter.spectrum().samples());
 
         if (ui->emittersList->currentRow() != index) {
             ui->emittersList->setCurrentRow(index);
@@ -99,30 +250,510 @@ void MainWindow::angleChanged(int angle)
 void MainWindow::addEmitter()
 {
     ui->plotArea->addEmitter();
-
-    ui->emittersList->addItem(tr("Emitter %1").arg(ui->emittersList->count() + 1));
-    ui->emittersList->setCurrentRow(ui->emittersList->count() - 1);
-
-    setControlsActive(true);
     ui->plotArea->setFocus();
 }
 
 void MainWindow::deleteEmitter()
 {
     int row = ui->emittersList->currentRow();
-    if (row != -1) {
-        delete ui->emittersList->takeItem(row);
 
+    if (row != -1) {
         ui->plotArea->removeEmitter(row);
     }
 
+    ui->plotArea->setFocus();
+}
+
+void MainWindow::importEmitters()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Import emitters"),
+                                                    QString(),
+                                                    tr("Text files (*.txt);;All files (*)"));
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QMessageBox::warning(this, tr("Import"), tr("Could not open %1").arg(fileName));
+        return;
+    }
+
+    // One emitter per line: x, y and angle in degrees
+    QList<RayEmitter> emitters;
+    QTextStream in(&file);
+
+    for (int line = 1; !in.atEnd(); line++) {
+        QString text = in.readLine().trimmed();
+
+        if (text.isEmpty() || text.startsWith('#')) {
+            continue;
+        }
+
+        QStringList fields = text.split(QRegExp("[\\s,]+"), QString::SkipEmptyParts);
+        bool okX = false, okY = false, okAngle = false;
+
+        if (fields.size() == 3) {
+            qreal x = fields.at(0).toDouble(&okX);
+            qreal y = fields.at(1).toDouble(&okY);
+            qreal angle = fields.at(2).toDouble(&okAngle);
+
+            if (okX && okY && okAngle && x < 0) {
+                emitters.append(RayEmitter(QPointF(x, y), angle * M_PI / 180.0));
+                continue;
+            }
+        }
+
+        QMessageBox::warning(this, tr("Import"),
+                             tr("Line %1 is not an emitter on the left of the lens: %2")
+                             .arg(line).arg(text));
+        return;
+    }
+
+    ui->plotArea->addEmitters(emitters);
+    ui->plotArea->setFocus();
+}
+
+void MainWindow::emittersInserted(int index, int count)
+{
+    QStringList names;
+
+    for (int i = 0; i < count; i++) {
+        names << tr("Emitter %1").arg(index + i + 1);
+    }
+
+    // The render widget selects the emitters itself
+    ui->emittersList->blockSignals(true);
+    ui->emittersList->insertItems(index, names);
+    ui->emittersList->blockSignals(false);
+
+    renameEmitters(index + count);
+
+    setControlsActive(true);
+}
+
+void MainWindow::emittersRemoved(int index, int count)
+{
+    ui->emittersList->blockSignals(true);
+
+    // One model update for the whole range
+    ui->emittersList->model()->removeRows(index, count);
+
+    ui->emittersList->blockSignals(false);
+
+    renameEmitters(index);
+
     if (ui->emittersList->count() == 0) {
         setControlsActive(false);
     }
+}
+
+void MainWindow::lensModeChanged(int mode)
+{
+    bool thin = mode == SceneRenderer::ThinLensMode;
+
+    ui->focalLengthLabel->setEnabled(thin);
+    ui->focalLengthSlider->setEnabled(thin);
+    ui->focalLengthBox->setEnabled(thin);
+
+    ui->frontRadiusLabel->setEnabled(!thin);
+    ui->frontRadiusBox->setEnabled(!thin);
+    ui->backRadiusLabel->setEnabled(!thin);
+    ui->backRadiusBox->setEnabled(!thin);
+    ui->thicknessLabel->setEnabled(!thin);
+    ui->thicknessBox->setEnabled(!thin);
+    ui->refractiveIndexLabel->setEnabled(!thin);
+    ui->refractiveIndexBox->setEnabled(!thin);
+}
+
+void MainWindow::thickLensChanged()
+{
+    ui->plotArea->editThickLens(thickLensFromBoxes());
+}
+
+void MainWindow::showThickLens(const ThickLens &lens)
+{
+    // Set together, so that no box sees the lens half changed
+    QDoubleSpinBox *boxes[] = { ui->frontRadiusBox, ui->backRadiusBox,
+                                ui->thicknessBox, ui->refractiveIndexBox };
+    const qreal values[] = { lens.frontRadius(), lens.backRadius(),
+                             lens.thickness(), lens.refractiveIndex() };
+
+    for (int i = 0; i < 4; i++) {
+        if (boxes[i]->value() != values[i]) {
+            boxes[i]->blockSignals(true);
+            boxes[i]->setValue(values[i]);
+            boxes[i]->blockSignals(false);
+        }
+    }
+
+    updateMagnification();
+}
+
+ThickLens MainWindow::thickLensFromBoxes() const
+{
+    return ThickLens(ui->frontRadiusBox->value(), ui->backRadiusBox->value(),
+                     ui->thicknessBox->value(), ui->refractiveIndexBox->value());
+}
+
+void MainWindow::dispersionChanged()
+{
+    Dispersion dispersion;
+
+    switch (ui->dispersionBox->currentIndex()) {
+    case AbbeNumberItem:
+        dispersion = Dispersion::abbe(ui->abbeNumberBox->value());
+        break;
+    case Bk7Item:
+        dispersion = Dispersion::sellmeier(kBk7B, kBk7C);
+        break;
+    case Sf11Item:
+        dispersion = Dispersion::sellmeier(kSf11B, kSf11C);
+        break;
+    default:
+        break;
+    }
+
+    ui->abbeNumberBox->setEnabled(ui->dispersionBox->currentIndex() == AbbeNumberItem);
+    ui->plotArea->setDispersion(dispersion);
+}
+
+void MainWindow::loadObject()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open object picture"),
+                                                    QString(),
+                                                    tr("Images (*.png *.jpg *.bmp)"));
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QImage image(fileName);
+
+    if (image.isNull()) {
+        QMessageBox::warning(this, tr("Object"), tr("Could not open %1").arg(fileName));
+        return;
+    }
+
+    ui->plotArea->setObjectImage(image);
+    ui->clearObjectButton->setEnabled(true);
+    ui->plotArea->setFocus();
+}
+
+void MainWindow::clearObject()
+{
+    ui->plotArea->setObjectImage(QImage());
+    ui->clearObjectButton->setEnabled(false);
+    ui->plotArea->setFocus();
+}
+
+void MainWindow::updateMagnification()
+{
+    if (ui->plotArea->objectImage().isNull()) {
+        ui->magnificationLabel->clear();
+        return;
+    }
+
+    qreal focalLength = ui->plotArea->sceneRenderer().effectiveFocalLength();
+    qreal objectX = ui->plotArea->objectRect().center().x();
+
+    qreal magnification = ImageMapper::magnification(objectX, focalLength);
+
+    // Image is on the other side of the lens if xi = m * xo > 0
+    bool real = magnification * objectX > 0;
+
+    ui->magnificationLabel->setText(tr("Magnification: %1 (%2)")
+                                    .arg(magnification, 0, 'f', 2)
+                                    .arg(real ? tr("real") : tr("virtual")));
+}
+
+void MainWindow::apertureChanged(const ApertureStatistics &statistics)
+{
+    if (statistics.rays == 0 || ui->plotArea->aperture().isNull()) {
+        ui->apertureLabel->clear();
+        return;
+    }
+
+    QString text = tr("Aperture: %1 of %2 rays (%3%)")
+            .arg(statistics.transmitted).arg(statistics.rays)
+            .arg(100.0 * statistics.transmitted / statistics.rays, 0, 'f', 1);
+
+    if (statistics.transmitted > 0) {
+        text += tr(", spread %1").arg(statistics.spread, 0, 'f', 2);
+    }
+
+    ui->apertureLabel->setText(text);
+}
+
+void MainWindow::addKeyframe()
+{
+    int next = m_track.keyframeCount() == 0 ? 0 : m_track.lastFrame() + kKeyframeStep;
+
+    bool ok;
+    int frame = QInputDialog::getInt(this, tr("Add keyframe"), tr("Frame:"),
+                                     next, 0, 100000, 1, &ok);
+
+    if (ok) {
+        m_track.addKeyframe(frame, ui->plotArea->lensFocalLength(),
+                            ui->plotArea->emitters());
+
+        ui->keyframesLabel->setText(tr("Keyframes: %1").arg(m_track.keyframeCount()));
+    }
+
+    ui->plotArea->setFocus();
+}
+
+void MainWindow::exportAnimation()
+{
+    if (m_exporter) {
+        return;
+    }
+
+    if (m_track.keyframeCount() < 2) {
+        QMessageBox::information(this, tr("Export"),
+                                 tr("Add at least two keyframes to export an animation."));
+        return;
+    }
+
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Export frames to"));
+
+    if (dir.isEmpty()) {
+        return;
+    }
+
+    m_exporter = new FrameExporter(this);
+    m_exporter->setTrack(m_track);
+    m_exporter->setRenderer(ui->plotArea->sceneRenderer());
+    m_exporter->setOutputDirectory(dir);
+
+    m_exportProgress = new QProgressDialog(tr("Exporting frames..."), tr("Cancel"),
+                                           0, m_exporter->frameCount(), this);
+    m_exportProgress->setWindowModality(Qt::WindowModal);
+    m_exportProgress->setMinimumDuration(0);
+
+    connect(m_exporter, SIGNAL(progress(int)), m_exportProgress, SLOT(setValue(int)));
+    connect(m_exportProgress, SIGNAL(canceled()), m_exporter, SLOT(cancel()));
+    connect(m_exporter, SIGNAL(finished()), SLOT(exportFinished()));
+
+    m_exporter->start();
+}
+
+void MainWindow::exportFinished()
+{
+    m_exportProgress->reset();
+
+    if (!m_exporter->errorString().isEmpty()) {
+        QMessageBox::warning(this, tr("Export"), m_exporter->errorString());
+    } else if (!m_exporter->wasCancelled()) {
+        QMessageBox::information(this, tr("Export"),
+                                 tr("%1 frames written, %2 frames per second.")
+                                 .arg(m_exporter->framesWritten())
+                                 .arg(m_exporter->framesPerSecond(), 0, 'f', 1));
+    }
+
+    m_exporter->deleteLater();
+    m_exporter = 0;
+
+    m_exportProgress->deleteLater();
+    m_exportProgress = 0;
+}
+
+void MainWindow::optimizeLens()
+{
+    if (m_optimizer) {
+        return;
+    }
+
+    SceneRenderer scene = ui->plotArea->sceneRenderer();
+
+    if (scene.rayCount() == 0) {
+        QMessageBox::information(this, tr("Optimize"),
+                                 tr("Add emitters or groups to optimize the lens for."));
+        return;
+    }
+
+    QStringList objectives;
+    objectives << tr("Spot size") << tr("Distance from a point");
+
+    bool ok;
+    QString objective = QInputDialog::getItem(this, tr("Optimize"), tr("Minimize:"),
+                                              objectives, 0, false, &ok);
+
+    if (!ok) {
+        return;
+    }
+
+    qreal planeX = QInputDialog::getDouble(this, tr("Optimize"), tr("Target plane x:"),
+                                           qAbs(scene.effectiveFocalLength()),
+                                           -10000, 10000, 1, &ok);
+
+    if (!ok) {
+        return;
+    }
+
+    qreal targetY = 0.0;
+
+    if (objective != objectives.first()) {
+        targetY = QInputDialog::getDouble(this, tr("Optimize"), tr("Target point y:"),
+                                          0, -10000, 10000, 1, &ok);
+
+        if (!ok) {
+            return;
+        }
+    }
+
+    m_optimizer = new LensOptimizer(this);
+    m_optimizer->setScene(scene);
+    m_optimizer->setObjective(objective == objectives.first()
+                              ? LensOptimizer::SpotSize : LensOptimizer::TargetDistance);
+    m_optimizer->setTarget(QPointF(planeX, targetY));
+
+    // The result is applied through the boxes, which would clamp it
+    if (scene.lensMode() == SceneRenderer::ThinLensMode) {
+        m_optimizer->setParameterRange(ui->focalLengthBox->minimum(),
+                                       ui->focalLengthBox->maximum());
+    } else {
+        m_optimizer->setParameterRange(qMax(ui->frontRadiusBox->minimum(),
+                                            ui->backRadiusBox->minimum()),
+                                       qMin(ui->frontRadiusBox->maximum(),
+                                            ui->backRadiusBox->maximum()));
+    }
+
+    m_optimizeProgress = new QProgressDialog(tr("Optimizing the lens..."), tr("Cancel"),
+                                             0, m_optimizer->maxIterations(), this);
+    m_optimizeProgress->setWindowModality(Qt::WindowModal);
+    m_optimizeProgress->setMinimumDuration(0);
+
+    connect(m_optimizer, SIGNAL(progress(int,double)),
+            SLOT(optimizationProgress(int,double)));
+    connect(m_optimizeProgress, SIGNAL(canceled()), m_optimizer, SLOT(cancel()));
+    connect(m_optimizer, SIGNAL(finished()), SLOT(optimizationFinished()));
+
+    m_optimizer->start();
+}
+
+void MainWindow::optimizationProgress(int iteration, double value)
+{
+    if (!m_optimizeProgress) {
+        return;
+    }
+
+    m_optimizeProgress->setLabelText(tr("Iteration %1, RMS distance %2")
+                                     .arg(iteration).arg(value, 0, 'f', 4));
+    m_optimizeProgress->setValue(iteration);
+}
+
+void MainWindow::optimizationFinished()
+{
+    m_optimizeProgress->reset();
+
+    if (!m_optimizer->wasCancelled()) {
+        if (ui->lensModeBox->currentIndex() == SceneRenderer::ThinLensMode) {
+            // Exactly, the box shows it rounded
+            ui->plotArea->editFocalLength(m_optimizer->bestFocalLength());
+        } else {
+            ThickLens lens = m_optimizer->bestThickLens();
+
+            ui->frontRadiusBox->setValue(lens.frontRadius());
+            ui->backRadiusBox->setValue(lens.backRadius());
+        }
+
+        // The radius boxes round the lens, so the value is that of the
+        // applied one
+        SceneRenderer scene = ui->plotArea->sceneRenderer();
+
+        QMessageBox::information(this, tr("Optimize"),
+                                 tr("RMS distance %1 with focal length %2.")
+                                 .arg(m_optimizer->valueFor(scene), 0, 'f', 4)
+                                 .arg(scene.effectiveFocalLength(), 0, 'f', 2));
+    }
+
+    m_optimizer->deleteLater();
+    m_optimizer = 0;
+
+    m_optimizeProgress->deleteLater();
+    m_optimizeProgress = 0;
+}
+
+void MainWindow::currentGroupChanged(int index)
+{
+    if (index != -1 && ui->groupsList->currentRow() != index) {
+        ui->groupsList->setCurrentRow(index);
+    }
+}
+
+void MainWindow::addGroup()
+{
+    bool ok;
+    int rays = QInputDialog::getInt(this, tr("Add group"), tr("Rays in a fan:"),
+                                    9, 1, 10000, 1, &ok);
+
+    if (!ok) {
+        return;
+    }
+
+    int heights = QInputDialog::getInt(this, tr("Add group"), tr("Number of fans:"),
+                                       5, 1, 100000, 1, &ok);
+
+    if (!ok) {
+        return;
+    }
+
+    ui->plotArea->addGroup(EmitterGroup::fan(rays, kGroupSpread * M_PI / 180.0,
+                                             heights, kGroupSpacing));
+    ui->plotArea->setFocus();
+}
+
+void MainWindow::deleteGroup()
+{
+    int row = ui->groupsList->currentRow();
+
+    if (row != -1) {
+        ui->plotArea->removeGroup(row);
+    }
 
     ui->plotArea->setFocus();
 }
 
+void MainWindow::groupInserted(int index)
+{
+    ui->groupsList->blockSignals(true);
+    ui->groupsList->insertItem(index, QString());
+    ui->groupsList->blockSignals(false);
+
+    renameGroups(index);
+}
+
+void MainWindow::groupRemoved(int index)
+{
+    ui->groupsList->blockSignals(true);
+    delete ui->groupsList->takeItem(index);
+    ui->groupsList->blockSignals(false);
+
+    renameGroups(index);
+}
+
+void MainWindow::renameEmitters(int first)
+{
+    for (int i = first; i < ui->emittersList->count(); i++) {
+        ui->emittersList->item(i)->setText(tr("Emitter %1").arg(i + 1));
+    }
+}
+
+void MainWindow::renameGroups(int first)
+{
+    for (int i = first; i < ui->groupsList->count(); i++) {
+        const EmitterGroup &group = ui->plotArea->groupAt(i);
+
+        ui->groupsList->item(i)->setText(tr("Group %1 (%2 x %3)")
+                                         .arg(i + 1)
+                                         .arg(group.prototype().size())
+                                         .arg(group.instances().size()));
+    }
+}
+
 void MainWindow::setControlsActive(bool active)
 {
     ui->sourcePositionLabel->setEnabled(active);
@@ -142,4 +773,7 @@ void MainWindow::setControlsActive(bool active)
     ui->sourceAngleBox->setEnabled(active);
     ui->sourceAngleSlider->setEnabled(active);
     ui->sourceAngleLabel->setEnabled(active);
+
+    ui->wavelengthsBox->setEnabled(active);
+    ui->wavelengthsLabel->setEnabled(active);
 }
@@ -25,10 +25,19 @@
 
 #include <QWidget>
 
+#include "animationtrack.h"
+#include "raysegmentindex.h"
+#include "thicklens.h"
+
 namespace Ui {
 class MainWindow;
 }
 
+class FrameExporter;
+class LensOptimizer;
+class EventRecorder;
+class QProgressDialog;
+
 class MainWindow : public QWidget
 {
     Q_OBJECT
@@ -37,6 +46,9 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+    // Makes the recorder follow the render widget and the controls
+    void recordInput(EventRecorder *recorder);
+
 private slots:
     void currentEmitterChanged(int index);
     void angleChanged(double angle);
@@ -44,11 +56,54 @@ private slots:
 
     void addEmitter();
     void deleteEmitter();
+    void importEmitters();
+
+    void emittersInserted(int index, int count);
+    void emittersRemoved(int index, int count);
+
+    void currentGroupChanged(int index);
+    void addGroup();
+    void deleteGroup();
+
+    void groupInserted(int index);
+    void groupRemoved(int index);
+
+    void lensModeChanged(int mode);
+    void thickLensChanged();
+    void showThickLens(const ThickLens &lens);
+    void dispersionChanged();
+
+    void loadObject();
+    void clearObject();
+    void updateMagnification();
+    void apertureChanged(const ApertureStatistics &statistics);
+
+    void addKeyframe();
+    void exportAnimation();
+    void exportFinished();
+
+    void optimizeLens();
+    void optimizationProgress(int iteration, double value);
+    void optimizationFinished();
 
 private:
     void setControlsActive(bool active);
 
+    ThickLens thickLensFromBoxes() const;
+
+    // Rows are named after their index, so the ones after a change are
+    // named again
+    void renameEmitters(int first);
+    void renameGroups(int first);
+
     Ui::MainWindow *ui;
+
+    AnimationTrack m_track;
+    FrameExporter *m_exporter;
+    QProgressDialog *m_exportProgress;
+
+    LensOptimizer *m_optimizer;
+    QProgressDialog *m_optimizeProgress;
 };
 
 #endif // MAINWINDOW_H
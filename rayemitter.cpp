@@ -73,6 +73,16 @@ void RayEmitter::setColor(const QColor &color)
     m_color = color;
 }
 
+Spectrum RayEmitter::spectrum() const
+{
+    return m_spectrum;
+}
+
+void RayEmitter::setSpectrum(const Spectrum &spectrum)
+{
+    m_spectrum = spectrum;
+}
+
 QPointF RayEmitter::planeIntersection(qreal planeX) const
 {
     return QPointF(planeX, slope() * (planeX - pos().x()) + pos().y());
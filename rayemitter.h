@@ -26,6 +26,8 @@
 #include <QPointF>
 #include <QColor>
 
+#include "spectrum.h"
+
 // Point that emits light in one direction
 class RayEmitter
 {
@@ -46,6 +48,10 @@ public:
     QColor color() const;
     void setColor(const QColor& color);
 
+    // Wavelengths the emitter is traced with. Monochromatic by default.
+    Spectrum spectrum() const;
+    void setSpectrum(const Spectrum &spectrum);
+
     // Coordinates of intersection with a line which is parallel to y-axis
     QPointF planeIntersection(qreal planeX) const;
 
@@ -54,6 +60,7 @@ private:
     qreal m_angle;
 
     QColor m_color;
+    Spectrum m_spectrum;
 };
 
 #endif // RAYEMITTER_H
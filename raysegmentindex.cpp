@@ -0,0 +1,600 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "raysegmentindex.h"
+#include "scenerenderer.h"
+
+#include <QBitArray>
+#include <QVarLengthArray>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Segments in a leaf
+const int kLeafSize = 8;
+
+// Levels split on the calling thread before the subtrees below are built
+// in parallel
+const int kParallelDepth = 4;
+
+// Smaller sets of segments are built on one thread
+const int kParallelBuildSize = 65536;
+
+namespace {
+
+void clearBox(RaySegmentNode &node)
+{
+    node.minX = std::numeric_limits<float>::max();
+    node.minY = std::numeric_limits<float>::max();
+    node.maxX = -std::numeric_limits<float>::max();
+    node.maxY = -std::numeric_limits<float>::max();
+}
+
+void growBox(RaySegmentNode &node, const RaySegment &s)
+{
+    node.minX = qMin(node.minX, qMin(s.x1, s.x2));
+    node.minY = qMin(node.minY, qMin(s.y1, s.y2));
+    node.maxX = qMax(node.maxX, qMax(s.x1, s.x2));
+    node.maxY = qMax(node.maxY, qMax(s.y1, s.y2));
+}
+
+void uniteBoxes(RaySegmentNode &node, const RaySegmentNode &a, const RaySegmentNode &b)
+{
+    node.minX = qMin(a.minX, b.minX);
+    node.minY = qMin(a.minY, b.minY);
+    node.maxX = qMax(a.maxX, b.maxX);
+    node.maxY = qMax(a.maxY, b.maxY);
+}
+
+// Squared distance from the point to the box, 0 inside
+double boxDistance2(const RaySegmentNode &node, double x, double y)
+{
+    double dx = qMax(0.0, qMax(node.minX - x, x - node.maxX));
+    double dy = qMax(0.0, qMax(node.minY - y, y - node.maxY));
+
+    return dx * dx + dy * dy;
+}
+
+double segmentDistance2(const RaySegment &s, double x, double y)
+{
+    double dx = s.x2 - s.x1;
+    double dy = s.y2 - s.y1;
+    double length2 = dx * dx + dy * dy;
+
+    double t = length2 > 0.0 ? ((x - s.x1) * dx + (y - s.y1) * dy) / length2 : 0.0;
+    t = qBound(0.0, t, 1.0);
+
+    double ex = s.x1 + t * dx - x;
+    double ey = s.y1 + t * dy - y;
+
+    return ex * ex + ey * ey;
+}
+
+// False if the whole box is on one side of the infinite line
+bool lineTouchesBox(const QLineF &line, const RaySegmentNode &node)
+{
+    double nx = line.y1() - line.y2();
+    double ny = line.x2() - line.x1();
+    double c = nx * line.x1() + ny * line.y1();
+
+    double d1 = nx * node.minX + ny * node.minY - c;
+    double d2 = nx * node.maxX + ny * node.minY - c;
+    double d3 = nx * node.minX + ny * node.maxY - c;
+    double d4 = nx * node.maxX + ny * node.maxY - c;
+
+    return !((d1 > 0 && d2 > 0 && d3 > 0 && d4 > 0)
+             || (d1 < 0 && d2 < 0 && d3 < 0 && d4 < 0));
+}
+
+// Parameter of the crossing on the line, false if the segment does not
+// cross it. Degenerate segments never do.
+bool crossing(const QLineF &line, const RaySegment &s, double *t)
+{
+    double rx = line.dx();
+    double ry = line.dy();
+    double sx = s.x2 - s.x1;
+    double sy = s.y2 - s.y1;
+
+    double denom = rx * sy - ry * sx;
+
+    if (denom == 0.0) {
+        return false;
+    }
+
+    double qx = s.x1 - line.x1();
+    double qy = s.y1 - line.y1();
+
+    double u = (qx * sy - qy * sx) / denom;
+    double v = (qx * ry - qy * rx) / denom;
+
+    if (u < 0.0 || u > 1.0 || v < 0.0 || v > 1.0) {
+        return false;
+    }
+
+    *t = u;
+    return true;
+}
+
+// Nodes of the subtrees over count and over count + 1 segments. Halving
+// gives sizes differing by one at most, so both follow from the half.
+void nodeCounts(int count, int *nodes, int *nextNodes)
+{
+    if (count + 1 <= kLeafSize) {
+        *nodes = 1;
+        *nextNodes = 1;
+        return;
+    }
+
+    int half;
+    int nextHalf;
+    nodeCounts(count / 2, &half, &nextHalf);
+
+    if (count % 2 == 0) {
+        *nodes = count <= kLeafSize ? 1 : 1 + 2 * half;
+        *nextNodes = 1 + half + nextHalf;
+    } else {
+        *nodes = count <= kLeafSize ? 1 : 1 + half + nextHalf;
+        *nextNodes = 1 + 2 * nextHalf;
+    }
+}
+
+int nodeCount(int count)
+{
+    int nodes;
+    int nextNodes;
+    nodeCounts(count, &nodes, &nextNodes);
+
+    return nodes;
+}
+
+class CentroidLess
+{
+public:
+    CentroidLess(const RaySegment *segments, bool xAxis)
+        : m_segments(segments), m_xAxis(xAxis) {}
+
+    bool operator()(int a, int b) const
+    {
+        const RaySegment &sa = m_segments[a];
+        const RaySegment &sb = m_segments[b];
+
+        if (m_xAxis) {
+            return sa.x1 + sa.x2 < sb.x1 + sb.x2;
+        }
+
+        return sa.y1 + sa.y2 < sb.y1 + sb.y2;
+    }
+
+private:
+    const RaySegment *m_segments;
+    bool m_xAxis;
+};
+
+struct BuildTask
+{
+    int node;
+    int begin;
+    int end;
+};
+
+// Splits the segments in halves along the longer side of their centroids.
+// The size of every subtree is known beforehand, so subtrees are placed
+// without waiting for each other and can be built in parallel.
+class HierarchyBuilder
+{
+public:
+    HierarchyBuilder(const RaySegment *segments, int *order, RaySegmentNode *nodes,
+                     int *parents, int *leaves)
+        : m_segments(segments), m_order(order), m_nodes(nodes),
+          m_parents(parents), m_leaves(leaves) {}
+
+    // Subtrees kParallelDepth levels down are added to tasks instead of
+    // being built, unless tasks is null
+    void build(int node, int begin, int end, int depth,
+               QVector<BuildTask> *tasks) const
+    {
+        if (tasks && depth == kParallelDepth) {
+            BuildTask task;
+            task.node = node;
+            task.begin = begin;
+            task.end = end;
+            tasks->append(task);
+            return;
+        }
+
+        RaySegmentNode &n = m_nodes[node];
+        clearBox(n);
+
+        float minX = std::numeric_limits<float>::max();
+        float minY = minX;
+        float maxX = -minX;
+        float maxY = -minX;
+
+        for (int i = begin; i < end; i++) {
+            const RaySegment &s = m_segments[m_order[i]];
+            growBox(n, s);
+
+            float cx = s.x1 + s.x2;
+            float cy = s.y1 + s.y2;
+
+            minX = qMin(minX, cx);
+            minY = qMin(minY, cy);
+            maxX = qMax(maxX, cx);
+            maxY = qMax(maxY, cy);
+        }
+
+        int count = end - begin;
+
+        if (count <= kLeafSize) {
+            n.first = begin;
+            n.count = count;
+
+            for (int i = begin; i < end; i++) {
+                m_leaves[m_order[i]] = node;
+            }
+
+            return;
+        }
+
+        int half = count / 2;
+        std::nth_element(m_order + begin, m_order + begin + half, m_order + end,
+                         CentroidLess(m_segments, maxX - minX >= maxY - minY));
+
+        int left = node + 1;
+        int right = left + nodeCount(half);
+
+        n.first = right;
+        n.count = 0;
+
+        m_parents[left] = node;
+        m_parents[right] = node;
+
+        build(left, begin, begin + half, depth + 1, tasks);
+        build(right, begin + half, end, depth + 1, tasks);
+    }
+
+    void operator()(const BuildTask &task) const
+    {
+        build(task.node, task.begin, task.end, 0, 0);
+    }
+
+private:
+    const RaySegment *m_segments;
+    int *m_order;
+    RaySegmentNode *m_nodes;
+    int *m_parents;
+    int *m_leaves;
+};
+
+}
+
+RaySegmentIndex::RaySegmentIndex() :
+    m_rays(0),
+    m_refitted(0)
+{
+}
+
+void RaySegmentIndex::build(const SceneRenderer &scene)
+{
+    int rays = scene.rayCount();
+
+    m_segments.resize(rays * kSegmentsPerRay);
+    scene.traceSegments(0, rays, m_segments.data());
+
+    int count = m_segments.size();
+
+    m_order.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        m_order[i] = i;
+    }
+
+    m_leaves.resize(count);
+    m_nodes.resize(count == 0 ? 0 : nodeCount(count));
+    m_parents.resize(m_nodes.size());
+    m_rays = rays;
+    m_refitted = 0;
+
+    if (count == 0) {
+        return;
+    }
+
+    m_parents[0] = -1;
+
+    HierarchyBuilder builder(m_segments.constData(), m_order.data(), m_nodes.data(),
+                             m_parents.data(), m_leaves.data());
+
+    if (count < kParallelBuildSize) {
+        builder.build(0, 0, count, 0, 0);
+    } else {
+        QVector<BuildTask> tasks;
+        builder.build(0, 0, count, 0, &tasks);
+
+        QtConcurrent::blockingMap(tasks, builder);
+    }
+}
+
+void RaySegmentIndex::update(const SceneRenderer &scene, int first, int count)
+{
+    int rays = scene.rayCount();
+    int capacity = m_segments.size() / kSegmentsPerRay;
+
+    // Rays removed from the end stay in the hierarchy, skipped by the
+    // queries, and rays added later take their place. Building again costs
+    // no more than the removal once fewer than half of them are left.
+    if (rays > capacity || rays < capacity / 2) {
+        build(scene);
+        return;
+    }
+
+    int end = count > 0 ? qMin(first + count, rays) : 0;
+
+    if (rays < m_rays) {
+        int removed = (m_rays - rays) * kSegmentsPerRay;
+        m_rays = rays;
+
+        if (removed > m_segments.size() / 8) {
+            refitAll();
+        } else {
+            for (int i = rays * kSegmentsPerRay; i < rays * kSegmentsPerRay + removed; i++) {
+                refitLeaf(m_leaves.at(i));
+            }
+        }
+    } else if (rays > m_rays) {
+        first = end > 0 ? qMin(first, m_rays) : m_rays;
+        end = rays;
+        m_rays = rays;
+    }
+
+    count = end - first;
+
+    if (count <= 0) {
+        return;
+    }
+
+    int segments = count * kSegmentsPerRay;
+
+    // Moving a few rays far stretches the boxes above them; once enough
+    // have moved, queries get faster with a new hierarchy
+    if (segments <= m_segments.size() / 8) {
+        m_refitted += segments;
+
+        if (m_refitted > m_segments.size() / 4) {
+            build(scene);
+            return;
+        }
+    }
+
+    scene.traceSegments(first, count, m_segments.data() + first * kSegmentsPerRay);
+
+    // Refitting every box at once is cheaper than walking up from many leaves
+    if (segments > m_segments.size() / 8) {
+        refitAll();
+        return;
+    }
+
+    for (int i = first * kSegmentsPerRay; i < (first + count) * kSegmentsPerRay; i++) {
+        refitLeaf(m_leaves.at(i));
+    }
+}
+
+int RaySegmentIndex::rayCount() const
+{
+    return m_rays;
+}
+
+int RaySegmentIndex::nearestRay(const QPointF &point, qreal maxDistance) const
+{
+    if (m_nodes.isEmpty()) {
+        return -1;
+    }
+
+    double x = point.x();
+    double y = point.y();
+
+    double best = maxDistance * maxDistance;
+    const int liveSegments = m_rays * kSegmentsPerRay;
+    int bestSegment = -1;
+
+    QVarLengthArray<int, 64> stack;
+    stack.append(0);
+
+    while (!stack.isEmpty()) {
+        int index = stack.last();
+        stack.removeLast();
+
+        const RaySegmentNode &node = m_nodes.at(index);
+
+        if (boxDistance2(node, x, y) > best) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                if (m_order.at(i) >= liveSegments) {
+                    continue;
+                }
+
+                double d = segmentDistance2(m_segments.at(m_order.at(i)), x, y);
+
+                if (d <= best) {
+                    best = d;
+                    bestSegment = m_order.at(i);
+                }
+            }
+
+            continue;
+        }
+
+        int left = index + 1;
+        int right = node.first;
+
+        // The nearer child is visited first, it is likely to shrink best
+        if (boxDistance2(m_nodes.at(left), x, y) < boxDistance2(m_nodes.at(right), x, y)) {
+            stack.append(right);
+            stack.append(left);
+        } else {
+            stack.append(left);
+            stack.append(right);
+        }
+    }
+
+    return bestSegment == -1 ? -1 : bestSegment / kSegmentsPerRay;
+}
+
+QVector<int> RaySegmentIndex::raysCrossing(const QLineF &line) const
+{
+    QVector<int> rays;
+    crossings(line, &rays, 0);
+
+    return rays;
+}
+
+ApertureStatistics RaySegmentIndex::aperture(const QLineF &line) const
+{
+    ApertureStatistics statistics;
+    statistics.rays = rayCount();
+
+    QVector<QPointF> points;
+    crossings(line, 0, &points);
+
+    statistics.transmitted = points.size();
+
+    if (points.isEmpty()) {
+        return statistics;
+    }
+
+    QPointF sum;
+
+    for (int i = 0; i < points.size(); i++) {
+        sum += points.at(i);
+    }
+
+    statistics.centroid = sum / points.size();
+
+    qreal squares = 0.0;
+
+    for (int i = 0; i < points.size(); i++) {
+        QPointF d = points.at(i) - statistics.centroid;
+        squares += d.x() * d.x() + d.y() * d.y();
+    }
+
+    statistics.spread = std::sqrt(squares / points.size());
+
+    return statistics;
+}
+
+void RaySegmentIndex::crossings(const QLineF &line, QVector<int> *rays,
+                                QVector<QPointF> *points) const
+{
+    if (m_nodes.isEmpty() || line.isNull()) {
+        return;
+    }
+
+    qreal minX = qMin(line.x1(), line.x2());
+    qreal minY = qMin(line.y1(), line.y2());
+    qreal maxX = qMax(line.x1(), line.x2());
+    qreal maxY = qMax(line.y1(), line.y2());
+
+    // A ray crossing the line more than once is counted once
+    QBitArray seen(rayCount());
+
+    QVarLengthArray<int, 64> stack;
+    stack.append(0);
+
+    while (!stack.isEmpty()) {
+        int index = stack.last();
+        stack.removeLast();
+
+        const RaySegmentNode &node = m_nodes.at(index);
+
+        if (node.maxX < minX || node.minX > maxX || node.maxY < minY || node.minY > maxY
+                || !lineTouchesBox(line, node)) {
+            continue;
+        }
+
+        if (node.count == 0) {
+            stack.append(index + 1);
+            stack.append(node.first);
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; i++) {
+            int segment = m_order.at(i);
+            int ray = segment / kSegmentsPerRay;
+            double t;
+
+            if (ray >= m_rays || seen.testBit(ray) || !crossing(line, m_segments.at(segment), &t)) {
+                continue;
+            }
+
+            seen.setBit(ray);
+
+            if (rays) {
+                rays->append(ray);
+            }
+
+            if (points) {
+                points->append(line.pointAt(t));
+            }
+        }
+    }
+}
+
+void RaySegmentIndex::refitLeaf(int node)
+{
+    RaySegmentNode &leaf = m_nodes[node];
+    clearBox(leaf);
+
+    for (int i = leaf.first; i < leaf.first + leaf.count; i++) {
+        if (m_order.at(i) < m_rays * kSegmentsPerRay) {
+            growBox(leaf, m_segments.at(m_order.at(i)));
+        }
+    }
+
+    for (int parent = m_parents.at(node); parent != -1; parent = m_parents.at(parent)) {
+        RaySegmentNode &n = m_nodes[parent];
+        uniteBoxes(n, m_nodes.at(parent + 1), m_nodes.at(n.first));
+    }
+}
+
+void RaySegmentIndex::refitAll()
+{
+    // Children always follow their parent
+    for (int i = m_nodes.size() - 1; i >= 0; i--) {
+        RaySegmentNode &node = m_nodes[i];
+
+        if (node.count > 0) {
+            clearBox(node);
+
+            for (int j = node.first; j < node.first + node.count; j++) {
+                if (m_order.at(j) < m_rays * kSegmentsPerRay) {
+                    growBox(node, m_segments.at(m_order.at(j)));
+                }
+            }
+        } else {
+            uniteBoxes(node, m_nodes.at(i + 1), m_nodes.at(node.first));
+        }
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef RAYSEGMENTINDEX_H
+#define RAYSEGMENTINDEX_H
+
+#include <QVector>
+#include <QPointF>
+#include <QLineF>
+
+class SceneRenderer;
+
+// Straight piece of a traced ray, in cartesian coordinates
+struct RaySegment
+{
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+};
+
+// Pieces every ray is made of. Rays with fewer pieces repeat their end point.
+const int kSegmentsPerRay = 3;
+
+// Node of the hierarchy. The left child of an inner node follows it, the
+// right one is at index first.
+struct RaySegmentNode
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+
+    // Leaf: segments first .. first + count - 1 of the order; inner: count is 0
+    int first;
+    int count;
+};
+
+// Rays going through an aperture
+struct ApertureStatistics
+{
+    ApertureStatistics() : rays(0), transmitted(0), spread(0.0) {}
+
+    // All the rays of the scene
+    int rays;
+
+    // Rays crossing the aperture
+    int transmitted;
+
+    // Mean crossing point and RMS distance of the crossings from it
+    QPointF centroid;
+    qreal spread;
+};
+
+// Bounding volume hierarchy over the segments of all the rays of a scene.
+// Finds the ray under the cursor or the rays crossing a line without
+// going over every ray. Moving some rays only refits the boxes above them.
+class RaySegmentIndex
+{
+public:
+    RaySegmentIndex();
+
+    // Traces all the rays of the scene and builds the hierarchy
+    void build(const SceneRenderer &scene);
+
+    // Retraces rays first .. first + count - 1 and refits the boxes. Rays
+    // added or removed at the end are retraced or dropped as well; the
+    // hierarchy is built again only if it has no room for the added ones or
+    // most of it is dropped.
+    void update(const SceneRenderer &scene, int first, int count);
+
+    int rayCount() const;
+
+    // Ray nearest to the point, -1 if none is closer than maxDistance
+    int nearestRay(const QPointF &point, qreal maxDistance) const;
+
+    // Rays with a segment crossing the line, each once
+    QVector<int> raysCrossing(const QLineF &line) const;
+
+    ApertureStatistics aperture(const QLineF &line) const;
+
+private:
+    void crossings(const QLineF &line, QVector<int> *rays,
+                   QVector<QPointF> *points) const;
+
+    void refitLeaf(int node);
+    void refitAll();
+
+    QVector<RaySegment> m_segments;
+    QVector<int> m_order;
+
+    QVector<RaySegmentNode> m_nodes;
+    QVector<int> m_parents;
+
+    // Leaf holding each segment
+    QVector<int> m_leaves;
+
+    // Rays of the scene. The segments after theirs belong to removed rays.
+    int m_rays;
+
+    // Segments moved by partial refits since the last build
+    int m_refitted;
+};
+
+#endif // RAYSEGMENTINDEX_H
@@ -0,0 +1,61 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "raytracer.h"
+
+#include <qmath.h>
+
+ThinLensTrace traceThinLens(const RayEmitter &emitter, qreal focalLength)
+{
+    ThinLensTrace trace;
+
+    // All rays parallel to this one converge at the focal plane in the
+    // point where the ray through the optical center crosses it
+    RayEmitter parallel(QPointF(0.0, 0.0), emitter.angle());
+
+    trace.lensIntersect = emitter.planeIntersection(0.0);
+    trace.focalPlaneIntersect = parallel.planeIntersection(focalLength);
+
+    trace.slope = double(trace.focalPlaneIntersect.y() - trace.lensIntersect.y()) /
+            (trace.focalPlaneIntersect.x() - trace.lensIntersect.x());
+
+    return trace;
+}
+
+void traceThinLens(const double *emitters, int count, qreal focalLength,
+                   double *result)
+{
+    for (int i = 0; i < count; i++) {
+        const double *em = emitters + i * kEmitterSize;
+        qreal slope = qTan(em[2]);
+
+        qreal lensY = em[1] - slope * em[0];
+        qreal focalY = slope * focalLength;
+
+        double *r = result + i * kThinLensTraceSize;
+        r[0] = 0.0;
+        r[1] = lensY;
+        r[2] = focalLength;
+        r[3] = focalY;
+        r[4] = (focalY - lensY) / focalLength;
+    }
+}
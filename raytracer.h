@@ -0,0 +1,55 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+#include <QPointF>
+
+#include "rayemitter.h"
+
+// Path of a ray through a thin lens placed at x = 0
+struct ThinLensTrace
+{
+    // Where the ray hits the lens
+    QPointF lensIntersect;
+
+    // Where the ray (or its backward extension for a diverging lens) crosses
+    // the back focal plane. Rays from the same direction meet there.
+    QPointF focalPlaneIntersect;
+
+    // Slope of the refracted ray
+    qreal slope;
+};
+
+ThinLensTrace traceThinLens(const RayEmitter &emitter, qreal focalLength);
+
+// Same as above for count rays stored as 3 values per ray: x, y and angle
+// in radians. Results are stored as 5 values per ray: lens x, lens y,
+// focal plane x, focal plane y, slope.
+void traceThinLens(const double *emitters, int count, qreal focalLength,
+                   double *result);
+
+const int kEmitterSize = 3;
+const int kThinLensTraceSize = 5;
+
+#endif // RAYTRACER_H
@@ -21,11 +21,14 @@
 */
 
 #include "renderwidget.h"
+#include "editjournal.h"
+#include "editcommands.h"
 
 #include <QPainter>
-#include <QBrush>
 #include <QWheelEvent>
 #include <QCoreApplication>
+#include <QTimer>
+#include <QToolTip>
 
 #include <QDebug>
 
@@ -33,21 +36,58 @@
 
 const qreal kMoveStep = 0.1;
 const qreal kZoomStep = 0.5;
-const int kEmitterRadius = 5;
 const qreal kScalingFactor = 10.0;
 
 const QPointF kDefaultPos(-25, 15);
 
+// Placement of a newly loaded object picture
+const qreal kObjectRight = -30.0;
+const qreal kObjectHeight = 10.0;
+
 QList<Qt::GlobalColor> kColors;
 
+// Controls whose consecutive changes are merged into one edit
+enum EditControl {
+    NoControl,
+    XBoxControl,
+    YBoxControl,
+    AngleBoxControl,
+    WavelengthsBoxControl,
+    FocalLengthBoxControl,
+    ThickLensControl
+};
+
+// A control left alone this long (ms) starts a new edit
+const int kControlEditInterval = 1000;
+
+// Half of the last digit shown by the angle box
+const qreal kAngleBoxTolerance = 0.051;
+
+// Rays closer to the cursor than this, in pixels, are highlighted
+const qreal kHoverDistance = 6.0;
+
 RenderWidget::RenderWidget(QWidget *parent) :
     QWidget(parent),
+    m_focalLength(0.0),
+    m_lensMode(SceneRenderer::ThinLensMode),
     m_offset(0, 0),
     m_scalingFactor(kScalingFactor),
     m_currentEmitter(-1),
+    m_currentGroup(-1),
     m_dragging(false),
     m_draggingEmitter(false),
-    m_lastColor(0)
+    m_draggingGroup(false),
+    m_draggingObject(false),
+    m_drawingAperture(false),
+    m_lastColor(0),
+    m_journal(new EditJournal(this)),
+    m_mergeKey(0),
+    m_editControl(NoControl),
+    m_rebuildRayIndex(true),
+    m_dirtyFirst(0),
+    m_dirtyEnd(0),
+    m_hoveredRay(-1),
+    m_apertureTimer(new QTimer(this))
 {
    kColors <<
        Qt::red<<
@@ -68,6 +108,11 @@ RenderWidget::RenderWidget(QWidget *parent) :
 
     setBackgroundRole(QPalette::Base);
     setAutoFillBackground(true);
+    setMouseTracking(true);
+
+    m_apertureTimer->setSingleShot(true);
+    m_apertureTimer->setInterval(0);
+    connect(m_apertureTimer, SIGNAL(timeout()), SLOT(updateAperture()));
 }
 
 const RayEmitter& RenderWidget::emitterAt(int index) const
@@ -75,10 +120,128 @@ const RayEmitter& RenderWidget::emitterAt(int index) const
     return m_emitters.at(index);
 }
 
+int RenderWidget::currentEmitter() const
+{
+    return m_currentEmitter;
+}
+
+EditJournal *RenderWidget::journal() const
+{
+    return m_journal;
+}
+
+void RenderWidget::addEmitters(const QList<RayEmitter> &emitters)
+{
+    if (emitters.isEmpty()) {
+        return;
+    }
+
+    QList<RayEmitter> colored = emitters;
+
+    for (int i = 0; i < colored.size(); i++) {
+        colored[i].setColor(kColors[m_lastColor++ % kColors.size()]);
+    }
+
+    m_journal->push(new InsertEmittersCommand(this, m_emitters.size(), colored));
+}
+
+void RenderWidget::removeEmitters(int index, int count)
+{
+    if (index < 0 || count <= 0 || index + count > m_emitters.size()) {
+        return;
+    }
+
+    m_journal->push(new RemoveEmittersCommand(this, index, count));
+}
+
+void RenderWidget::replaceEmitter(int index, const RayEmitter &emitter)
+{
+    m_emitters[index] = emitter;
+    invalidateRays(index, 1);
+
+    // The edited emitter is selected so that undo shows what it changed
+    setCurrentEmitter(index);
+}
+
+void RenderWidget::insertEmitters(int index, const QList<RayEmitter> &emitters)
+{
+    // Undoing an import or a removal at the end appends
+    if (index == m_emitters.size()) {
+        m_emitters.append(emitters);
+    } else {
+        QList<RayEmitter> tail = m_emitters.mid(index);
+        m_emitters.erase(m_emitters.begin() + index, m_emitters.end());
+
+        m_emitters.append(emitters);
+        m_emitters.append(tail);
+    }
+
+    invalidateRaysFrom(index);
+
+    emit emittersInserted(index, emitters.size());
+
+    setCurrentEmitter(index);
+}
+
+QList<RayEmitter> RenderWidget::takeEmitters(int index, int count)
+{
+    QList<RayEmitter> taken = m_emitters.mid(index, count);
+    m_emitters.erase(m_emitters.begin() + index, m_emitters.begin() + index + count);
+    invalidateRaysFrom(index);
+
+    if (m_currentEmitter >= index + count) {
+        m_currentEmitter -= count;
+    } else if (m_currentEmitter >= index) {
+        m_currentEmitter = qMin(index, m_emitters.size() - 1);
+    }
+
+    emit emittersRemoved(index, count);
+
+    setCurrentEmitter(m_currentEmitter);
+
+    return taken;
+}
+
+void RenderWidget::setGroupPos(int index, const QPointF &pos)
+{
+    m_groups[index].setPos(pos);
+    invalidateRays(groupFirstRay(index), m_groups.at(index).rayCount());
+    update();
+}
+
+void RenderWidget::insertGroup(int index, const EmitterGroup &group)
+{
+    m_groups.insert(index, group);
+    invalidateAllRays(true);
+    emit groupInserted(index);
+
+    setCurrentGroup(index);
+}
+
+EmitterGroup RenderWidget::takeGroup(int index)
+{
+    EmitterGroup group = m_groups.takeAt(index);
+    invalidateAllRays(true);
+
+    if (m_currentGroup > index || m_currentGroup >= m_groups.size()) {
+        m_currentGroup--;
+    }
+
+    emit groupRemoved(index);
+
+    setCurrentGroup(m_currentGroup);
+
+    return group;
+}
+
 void RenderWidget::setLensFocalLength(qreal len)
 {
     if (m_focalLength != len) {
         m_focalLength = len;
+        invalidateAllRays(false);
+
+        emit focalLengthChanged(qRound(len));
+
         update();
     }
 }
@@ -88,168 +251,303 @@ qreal RenderWidget::lensFocalLength() const
     return m_focalLength;
 }
 
-inline QPoint RenderWidget::cartesianToInternal(const QPointF &point)
+void RenderWidget::setThickLens(const ThickLens &lens)
 {
-    QPoint newPoint((this->width() / 2) + point.x() * m_scalingFactor,
-                    (this->height() / 2) - point.y() * m_scalingFactor);
+    m_thickLens = lens;
+    invalidateAllRays(false);
 
-    return newPoint;
+    emit thickLensChanged(lens);
+
+    update();
 }
 
-inline QPointF RenderWidget::internalToCartesian(const QPoint &point)
+void RenderWidget::editThickLens(const ThickLens &lens)
 {
-    QPointF newPoint((point.x() - this->width() / 2) / m_scalingFactor,
-                     (this->height() / 2 - point.y()) / m_scalingFactor);
-    return newPoint;
+    if (lens.frontRadius() == m_thickLens.frontRadius()
+            && lens.backRadius() == m_thickLens.backRadius()
+            && lens.thickness() == m_thickLens.thickness()
+            && lens.refractiveIndex() == m_thickLens.refractiveIndex()) {
+        return;
+    }
+
+    ThickLensCommand *command = new ThickLensCommand(this, m_thickLens, lens);
+    command->setMergeKey(controlMergeKey(ThickLensControl));
+    m_journal->push(command);
+}
+
+ThickLens RenderWidget::thickLens() const
+{
+    return m_thickLens;
 }
 
-void RenderWidget::paintAxis(QPainter &p)
+void RenderWidget::setDispersion(const Dispersion &dispersion)
 {
-    int axisY = height() / 2;
-    p.drawLine(-m_offset.x(), axisY, width() - m_offset.x(), axisY);
+    m_dispersion = dispersion;
+    update();
+}
+
+Dispersion RenderWidget::dispersion() const
+{
+    return m_dispersion;
+}
+
+void RenderWidget::setObjectImage(const QImage &image)
+{
+    m_objectImage = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    if (!image.isNull()) {
+        qreal width = kObjectHeight * image.width() / image.height();
+        m_objectRect = QRectF(kObjectRight - width, 0, width, kObjectHeight);
+    }
+
+    emit objectMoved();
+    update();
+}
 
-    // Focuses
-    QPoint tick1 = cartesianToInternal(QPointF(m_focalLength, 0));
-    QPoint tick2 = cartesianToInternal(QPointF(-m_focalLength, 0));
+QImage RenderWidget::objectImage() const
+{
+    return m_objectImage;
+}
 
-    const int tickHeight = 10;
+QRectF RenderWidget::objectRect() const
+{
+    return m_objectRect;
+}
 
-    p.drawLine(tick1.x(), tick1.y() + tickHeight,
-               tick1.x(), tick1.y() - tickHeight);
+const EmitterGroup& RenderWidget::groupAt(int index) const
+{
+    return m_groups.at(index);
+}
 
-    p.drawLine(tick2.x(), tick2.y() + tickHeight,
-               tick2.x(), tick2.y() - tickHeight);
+const QList<EmitterGroup>& RenderWidget::groups() const
+{
+    return m_groups;
+}
 
-    // Focal planes
-    p.save();
+const QList<RayEmitter>& RenderWidget::emitters() const
+{
+    return m_emitters;
+}
 
-    p.setPen(Qt::DashLine);
+QLineF RenderWidget::aperture() const
+{
+    return m_aperture;
+}
 
-    p.drawLine(tick1.x(), -m_offset.y(), tick1.x(), height() - m_offset.y());
-    p.drawLine(tick2.x(), -m_offset.y(), tick2.x(), height() - m_offset.y());
+void RenderWidget::setAperture(const QLineF &aperture)
+{
+    m_aperture = aperture;
+    m_apertureTimer->start();
 
-    p.restore();
+    update();
 }
 
-void RenderWidget::paintLens(QPainter &p)
+ApertureStatistics RenderWidget::apertureStatistics()
 {
-    const int offset = 40;
-    const int capWidth = 20;
+    if (m_aperture.isNull()) {
+        return ApertureStatistics();
+    }
 
-    p.save();
+    updateRayIndex();
+    return m_rayIndex.aperture(m_aperture);
+}
 
-    p.setPen(QPen(QBrush(Qt::black), 2));
+SceneRenderer RenderWidget::sceneRenderer() const
+{
+    SceneRenderer renderer;
+    setUpRenderer(renderer);
 
-    p.drawLine(width() / 2, offset,
-               width() / 2, height() - offset);
+    return renderer;
+}
 
-    if (m_focalLength > 0) {
-        p.drawLine(width() / 2, offset,
-                   width() / 2 - capWidth, offset + capWidth);
+void RenderWidget::setUpRenderer(SceneRenderer &renderer) const
+{
+    renderer.setEmitters(m_emitters);
+    renderer.setFocalLength(m_focalLength);
+    renderer.setLensMode(m_lensMode);
+    renderer.setThickLens(m_thickLens);
+    renderer.setDispersion(m_dispersion);
+    renderer.setObjectImage(m_objectImage);
+    renderer.setObjectRect(m_objectRect);
+    renderer.setCurrentEmitter(m_currentEmitter);
+    renderer.setGroups(m_groups);
+    renderer.setCurrentGroup(m_currentGroup);
+    renderer.setHighlightedRay(m_hoveredRay);
+    renderer.setAperture(m_aperture);
+    renderer.setSize(size());
+    renderer.setOffset(m_offset);
+    renderer.setScalingFactor(m_scalingFactor);
+}
 
-        p.drawLine(width() / 2, offset,
-                   width() / 2 + capWidth, offset + capWidth);
+inline QPoint RenderWidget::cartesianToInternal(const QPointF &point)
+{
+    QPoint newPoint((this->width() / 2) + point.x() * m_scalingFactor,
+                    (this->height() / 2) - point.y() * m_scalingFactor);
 
-        p.drawLine(width() / 2, height() - offset,
-                   width() / 2 - capWidth,
-                   height() - offset - capWidth);
+    return newPoint;
+}
 
-        p.drawLine(width() / 2, height() - offset,
-                   width() / 2 + capWidth,
-                   height() - offset - capWidth);
-    } else {
-        p.drawLine(width() / 2, offset,
-                   width() / 2 - capWidth, offset - capWidth);
+inline QPointF RenderWidget::internalToCartesian(const QPoint &point)
+{
+    QPointF newPoint((point.x() - this->width() / 2) / m_scalingFactor,
+                     (this->height() / 2 - point.y()) / m_scalingFactor);
+    return newPoint;
+}
+
+void RenderWidget::beginEdit()
+{
+    m_mergeKey++;
+    m_editControl = NoControl;
+}
 
-        p.drawLine(width() / 2, offset,
-                   width() / 2 + capWidth, offset - capWidth);
+int RenderWidget::controlMergeKey(int control)
+{
+    if (control != m_editControl || m_editTimer.hasExpired(kControlEditInterval)) {
+        beginEdit();
+        m_editControl = control;
+    }
+
+    m_editTimer.start();
+
+    return m_mergeKey;
+}
 
-        p.drawLine(width() / 2, height() - offset,
-                   width() / 2 - capWidth,
-                   height() - offset + capWidth);
+void RenderWidget::editCurrentEmitter(const RayEmitter &emitter, int mergeKey)
+{
+    EditEmitterCommand *command =
+            new EditEmitterCommand(this, m_currentEmitter,
+                                   EmitterFields::of(m_emitters.at(m_currentEmitter)),
+                                   EmitterFields::of(emitter));
 
-        p.drawLine(width() / 2, height() - offset,
-                   width() / 2 + capWidth,
-                   height() - offset + capWidth);
+    if (command->isEmpty()) {
+        delete command;
+        return;
     }
 
-    p.restore();
+    command->setMergeKey(mergeKey);
+    m_journal->push(command);
 }
 
-void RenderWidget::paintEmitter(QPainter &p, const QPoint &pos, bool selected)
+void RenderWidget::invalidateRays(int first, int count)
 {
-    p.save();
+    if (count <= 0) {
+        return;
+    }
+
+    if (m_dirtyEnd == 0) {
+        m_dirtyFirst = first;
+        m_dirtyEnd = first + count;
+    } else {
+        m_dirtyFirst = qMin(m_dirtyFirst, first);
+        m_dirtyEnd = qMax(m_dirtyEnd, first + count);
+    }
 
-    p.setPen(QPen(QBrush(Qt::red), 1));
+    if (!m_aperture.isNull()) {
+        m_apertureTimer->start();
+    }
+}
+
+void RenderWidget::invalidateAllRays(bool structure)
+{
+    if (structure) {
+        m_rebuildRayIndex = true;
+        m_hoveredRay = -1;
 
-    if (selected) {
-        p.setBrush(QBrush(Qt::green));
+        if (!m_aperture.isNull()) {
+            m_apertureTimer->start();
+        }
     } else {
-        p.setBrush(QBrush(Qt::red));
+        invalidateRays(0, groupFirstRay(m_groups.size()));
     }
+}
 
-    p.drawEllipse(pos, kEmitterRadius, kEmitterRadius);
+void RenderWidget::invalidateRaysFrom(int first)
+{
+    m_hoveredRay = -1;
+    invalidateRays(first, groupFirstRay(m_groups.size()) - first);
 
-    p.restore();
+    // Nothing is left to retrace after a removal at the end
+    if (!m_aperture.isNull()) {
+        m_apertureTimer->start();
+    }
 }
 
-void RenderWidget::paintRay(QPainter &p, const RayEmitter &emitter)
+void RenderWidget::updateRayIndex()
 {
-    p.save();
+    if (m_rebuildRayIndex) {
+        m_rayIndex.build(sceneRenderer());
+        m_rebuildRayIndex = false;
+    } else if (m_dirtyEnd != 0
+               || m_rayIndex.rayCount() != groupFirstRay(m_groups.size())) {
+        m_rayIndex.update(sceneRenderer(), m_dirtyFirst, m_dirtyEnd - m_dirtyFirst);
+    }
 
-    p.setPen(QPen(QBrush(emitter.color()), 2));
+    m_dirtyEnd = 0;
+}
 
-    RayEmitter parallel(QPointF(0.0, 0.0), emitter.angle());
+int RenderWidget::groupFirstRay(int index) const
+{
+    int first = m_emitters.size();
 
-    QPointF lensIntersect = emitter.planeIntersection(0.0);
-    QPointF focalPlaneIntersect
-            = parallel.planeIntersection(m_focalLength);
+    for (int i = 0; i < index; i++) {
+        first += m_groups.at(i).rayCount();
+    }
+
+    return first;
+}
 
-    qreal newSlope = double(focalPlaneIntersect.y() - lensIntersect.y()) /
-            (focalPlaneIntersect.x() - lensIntersect.x());
+void RenderWidget::hoverAt(const QPoint &pos, const QPoint &globalPos)
+{
+    updateRayIndex();
 
-    qreal infX = 20 * qAbs(m_focalLength);
-    QPointF inf = QPointF(infX, newSlope * infX + lensIntersect.y());
+    QPointF point = internalToCartesian(pos - m_offset);
+    int ray = m_rayIndex.nearestRay(point, kHoverDistance / m_scalingFactor);
 
-    QPolygon ray;
+    if (ray == m_hoveredRay) {
+        return;
+    }
 
-    ray << cartesianToInternal(emitter.pos())
-        << cartesianToInternal(lensIntersect);
+    m_hoveredRay = ray;
 
-    if (m_focalLength > 0) {
-        ray << cartesianToInternal(focalPlaneIntersect);
+    if (ray == -1) {
+        QToolTip::hideText();
+    } else if (ray < m_emitters.size()) {
+        QToolTip::showText(globalPos, tr("Emitter %1").arg(ray + 1), this);
     } else {
-        p.save();
+        int group = 0;
+        int first = m_emitters.size();
 
-        p.setPen(QPen(QBrush(emitter.color()), 1, Qt::DashLine));
-        p.drawLine(cartesianToInternal(lensIntersect),
-                   cartesianToInternal(focalPlaneIntersect));
+        while (first + m_groups.at(group).rayCount() <= ray) {
+            first += m_groups.at(group++).rayCount();
+        }
 
-        p.restore();
+        QToolTip::showText(globalPos, tr("Group %1, ray %2").arg(group + 1)
+                           .arg(ray - first + 1), this);
     }
 
-    ray << cartesianToInternal(inf);
-
-    p.drawPolyline(ray);
+    update();
+}
 
-    p.restore();
+void RenderWidget::updateAperture()
+{
+    emit apertureChanged(apertureStatistics());
 }
 
 void RenderWidget::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event)
 
-    QPainter p(this);
-    p.translate(m_offset);
-    p.setRenderHint(QPainter::Antialiasing, true);
+    // Aperture statistics pending since the last change belong to this frame
+    if (m_apertureTimer->isActive()) {
+        m_apertureTimer->stop();
+        updateAperture();
+    }
 
-    paintAxis(p);
-    paintLens(p);
+    // The renderer is kept between paints for the mapped object picture
+    setUpRenderer(m_renderer);
 
-    for (int i = 0; i < m_emitters.size(); i++) {
-        paintEmitter(p, cartesianToInternal(m_emitters.at(i).pos()), i == m_currentEmitter);
-        paintRay(p, m_emitters.at(i));
-    }
+    QPainter p(this);
+    m_renderer.render(p);
 }
 
 void RenderWidget::wheelEvent(QWheelEvent *event)
@@ -262,7 +560,7 @@ void RenderWidget::wheelEvent(QWheelEvent *event)
 void RenderWidget::keyPressEvent(QKeyEvent *event)
 {
     if (m_currentEmitter != -1) {
-        RayEmitter& em = m_emitters[m_currentEmitter];
+        RayEmitter em = m_emitters.at(m_currentEmitter);
         QPointF emPos = em.pos();
 
         const qreal angleStep = 0.5;
@@ -301,18 +599,31 @@ void RenderWidget::keyPressEvent(QKeyEvent *event)
 
         em.setPos(emPos);
 
-        emit currentEmitterChanged(m_currentEmitter);
+        // Holding a key down makes a single edit
+        if (!event->isAutoRepeat()) {
+            beginEdit();
+        }
+
+        editCurrentEmitter(em, m_mergeKey);
     } else {
         QWidget::keyPressEvent(event);
-        return;
     }
-
-    update();
 }
 
 void RenderWidget::mousePressEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
+        beginEdit();
+
+        if (event->modifiers().testFlag(Qt::ShiftModifier)) {
+            QPointF point = internalToCartesian(event->pos() - m_offset);
+
+            m_drawingAperture = true;
+            setAperture(QLineF(point, point));
+
+            return;
+        }
+
         int eventX = event->pos().x();
         int eventY = event->pos().y();
 
@@ -330,15 +641,34 @@ void RenderWidget::mousePressEvent(QMouseEvent *event)
             }
         }
 
+        for (int i = 0; i < m_groups.size() && !m_draggingEmitter; i++) {
+            QPoint groupPos = cartesianToInternal(m_groups.at(i).pos()) + m_offset;
+
+            if (qAbs(eventX - groupPos.x()) < 10 && qAbs(eventY - groupPos.y()) < 10) {
+                setCurrentGroup(i);
+                m_draggingGroup = true;
+
+                break;
+            }
+        }
+
+        if (!m_draggingEmitter && !m_draggingGroup && !m_objectImage.isNull()
+                && m_objectRect.contains(internalToCartesian(event->pos() - m_offset))) {
+            m_draggingObject = true;
+        }
+
         m_lastMousePos = event->pos();
 
-        if (!m_draggingEmitter) {
+        if (!m_draggingEmitter && !m_draggingGroup && !m_draggingObject) {
             m_dragging = true;
             setCursor(QCursor(Qt::ClosedHandCursor));
         }
     } else {
         m_dragging = false;
         m_draggingEmitter = false;
+        m_draggingGroup = false;
+        m_draggingObject = false;
+        m_drawingAperture = false;
         event->ignore();
     }
 }
@@ -351,7 +681,7 @@ void RenderWidget::mouseMoveEvent(QMouseEvent *event)
 
         update();
     } else if (m_draggingEmitter) {
-        RayEmitter& em = m_emitters[m_currentEmitter];
+        RayEmitter em = m_emitters.at(m_currentEmitter);
         QPointF emPos;
         QPoint offset = m_lastMousePos - event->pos();
 
@@ -364,8 +694,41 @@ void RenderWidget::mouseMoveEvent(QMouseEvent *event)
         m_lastMousePos = event->pos();
         em.setPos(emPos);
 
-        emit currentEmitterChanged(m_currentEmitter);
+        editCurrentEmitter(em, m_mergeKey);
+    } else if (m_draggingGroup) {
+        QPointF oldPos = m_groups.at(m_currentGroup).pos();
+        QPointF pos = oldPos + internalToCartesian(event->pos())
+                - internalToCartesian(m_lastMousePos);
+
+        if (pos.x() > -1) {
+            pos.setX(-1);
+        }
+
+        m_lastMousePos = event->pos();
+
+        MoveGroupCommand *command = new MoveGroupCommand(this, m_currentGroup, oldPos, pos);
+        command->setMergeKey(m_mergeKey);
+        m_journal->push(command);
+    } else if (m_draggingObject) {
+        QPointF delta = internalToCartesian(event->pos())
+                - internalToCartesian(m_lastMousePos);
+
+        QRectF rect = m_objectRect.translated(delta);
+
+        // Like emitters, the object stays on the left of the lens
+        if (rect.right() > -1) {
+            rect.moveRight(-1);
+        }
+
+        m_lastMousePos = event->pos();
+        m_objectRect = rect;
+
+        emit objectMoved();
         update();
+    } else if (m_drawingAperture) {
+        setAperture(QLineF(m_aperture.p1(), internalToCartesian(event->pos() - m_offset)));
+    } else if (event->buttons() == Qt::NoButton) {
+        hoverAt(event->pos(), event->globalPos());
     } else {
         event->ignore();
     }
@@ -376,45 +739,88 @@ void RenderWidget::mouseReleaseEvent(QMouseEvent *event)
     if (event->button() == Qt::LeftButton) {
         m_dragging = false;
         m_draggingEmitter = false;
+        m_draggingGroup = false;
+        m_draggingObject = false;
+        m_drawingAperture = false;
         setCursor(QCursor(Qt::ArrowCursor));
     } else {
         event->ignore();
     }
 }
 
+void RenderWidget::leaveEvent(QEvent *event)
+{
+    Q_UNUSED(event)
+
+    if (m_hoveredRay != -1) {
+        m_hoveredRay = -1;
+        update();
+    }
+}
+
 void RenderWidget::emitterXChanged(int newValue)
 {
-    RayEmitter &emitter = m_emitters[m_currentEmitter];
+    RayEmitter emitter = m_emitters.at(m_currentEmitter);
 
     if (static_cast<int>(emitter.pos().x()) != newValue) {
         emitter.setPos(QPointF(newValue, emitter.pos().y()));
-
-        update();
+        editCurrentEmitter(emitter, controlMergeKey(XBoxControl));
     }
 }
 
 void RenderWidget::emitterYChanged(int newValue)
 {
-    RayEmitter &emitter = m_emitters[m_currentEmitter];
+    RayEmitter emitter = m_emitters.at(m_currentEmitter);
 
     if (static_cast<int>(emitter.pos().y()) != newValue) {
         emitter.setPos(QPointF(emitter.pos().x(), newValue));
-
-        update();
+        editCurrentEmitter(emitter, controlMergeKey(YBoxControl));
     }
 }
 
 void RenderWidget::emitterAngleChanged(double newValue)
 {
-    RayEmitter &emitter = m_emitters[m_currentEmitter];
-    emitter.setAngle(newValue * M_PI / 180.0);
+    RayEmitter emitter = m_emitters.at(m_currentEmitter);
 
-    update();
+    // Showing the angle of the current emitter in the box is not an edit
+    if (qAbs(emitter.angle() * 180.0 / M_PI - newValue) > kAngleBoxTolerance) {
+        emitter.setAngle(newValue * M_PI / 180.0);
+        editCurrentEmitter(emitter, controlMergeKey(AngleBoxControl));
+    }
+}
+
+void RenderWidget::emitterWavelengthsChanged(int samples)
+{
+    RayEmitter emitter = m_emitters.at(m_currentEmitter);
+
+    if (emitter.spectrum().samples() != samples) {
+        emitter.setSpectrum(Spectrum(samples));
+        editCurrentEmitter(emitter, controlMergeKey(WavelengthsBoxControl));
+    }
+}
+
+void RenderWidget::editFocalLength(qreal len)
+{
+    if (m_focalLength != len) {
+        m_journal->push(new FocalLengthCommand(this, m_focalLength, len));
+    }
 }
 
 void RenderWidget::lensFocalLengthChanged(int newValue)
 {
-    m_focalLength = newValue;
+    // The box shows the focal length rounded, e.g. after an optimization
+    if (qRound(m_focalLength) != newValue) {
+        FocalLengthCommand *command = new FocalLengthCommand(this, m_focalLength, newValue);
+        command->setMergeKey(controlMergeKey(FocalLengthBoxControl));
+        m_journal->push(command);
+    }
+}
+
+void RenderWidget::setLensMode(int mode)
+{
+    m_lensMode = static_cast<SceneRenderer::LensMode>(mode);
+    invalidateAllRays(false);
+
     update();
 }
 
@@ -423,14 +829,13 @@ void RenderWidget::addEmitter()
     RayEmitter em(kDefaultPos, 0);
     em.setColor(kColors[m_lastColor++ % kColors.size()]);
 
-    m_emitters.append(em);
-    update();
+    m_journal->push(new InsertEmittersCommand(this, m_emitters.size(),
+                                              QList<RayEmitter>() << em));
 }
 
 void RenderWidget::removeEmitter(int index)
 {
-    m_emitters.removeAt(index);
-    update();
+    removeEmitters(index, 1);
 }
 
 void RenderWidget::setCurrentEmitter(int index)
@@ -440,3 +845,29 @@ void RenderWidget::setCurrentEmitter(int index)
 
     update();
 }
+
+void RenderWidget::addGroup(const EmitterGroup &group)
+{
+    EmitterGroup g = group;
+    g.setPos(kDefaultPos);
+    g.setColor(kColors[m_lastColor++ % kColors.size()]);
+
+    m_journal->push(new InsertGroupCommand(this, m_groups.size(), g));
+}
+
+void RenderWidget::removeGroup(int index)
+{
+    if (index < 0 || index >= m_groups.size()) {
+        return;
+    }
+
+    m_journal->push(new InsertGroupCommand(this, index, m_groups.at(index), true));
+}
+
+void RenderWidget::setCurrentGroup(int index)
+{
+    m_currentGroup = index;
+    emit currentGroupChanged(index);
+
+    update();
+}
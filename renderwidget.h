@@ -25,8 +25,15 @@
 
 #include <QWidget>
 #include <QVector2D>
+#include <QElapsedTimer>
 
 #include "rayemitter.h"
+#include "scenerenderer.h"
+#include "emittergroup.h"
+#include "raysegmentindex.h"
+
+class EditJournal;
+class QTimer;
 
 class RenderWidget : public QWidget
 {
@@ -35,22 +42,100 @@ public:
     explicit RenderWidget(QWidget *parent = 0);
 
     const RayEmitter& emitterAt(int index) const;
+    int currentEmitter() const;
+
+    // History of the edits of emitters, groups and the lens
+    EditJournal *journal() const;
+
+    // Appends emitters as a single edit
+    void addEmitters(const QList<RayEmitter> &emitters);
+    void removeEmitters(int index, int count);
+
+    // Changes applied by edit commands, they are not recorded in the journal
+    void replaceEmitter(int index, const RayEmitter &emitter);
+    void insertEmitters(int index, const QList<RayEmitter> &emitters);
+    QList<RayEmitter> takeEmitters(int index, int count);
+
+    void setGroupPos(int index, const QPointF &pos);
+    void insertGroup(int index, const EmitterGroup &group);
+    EmitterGroup takeGroup(int index);
 
     void setLensFocalLength(qreal len);
     qreal lensFocalLength() const;
 
+    void setThickLens(const ThickLens &lens);
+    ThickLens thickLens() const;
+
+    // Records the change of the thick lens made with the controls
+    void editThickLens(const ThickLens &lens);
+
+    // Records the change of the focal length as a separate edit
+    void editFocalLength(qreal len);
+
+    void setDispersion(const Dispersion &dispersion);
+    Dispersion dispersion() const;
+
+    // Picture imaged by the lens, null image to remove it
+    void setObjectImage(const QImage &image);
+    QImage objectImage() const;
+
+    // Position of the picture in cartesian coordinates
+    QRectF objectRect() const;
+
+    const QList<RayEmitter>& emitters() const;
+
+    const EmitterGroup& groupAt(int index) const;
+    const QList<EmitterGroup>& groups() const;
+
+    // Line drawn with Shift and the left mouse button, null if none
+    QLineF aperture() const;
+    void setAperture(const QLineF &aperture);
+
+    ApertureStatistics apertureStatistics();
+
+    // Renderer set up with the current scene and view
+    SceneRenderer sceneRenderer() const;
+
 public slots:
     void emitterXChanged(int newValue);
     void emitterYChanged(int newValue);
     void emitterAngleChanged(double newValue);
+
+    // Number of wavelengths the current emitter is traced with
+    void emitterWavelengthsChanged(int samples);
     void lensFocalLengthChanged(int newValue);
 
+    // One of SceneRenderer::LensMode
+    void setLensMode(int mode);
+
     void addEmitter();
     void removeEmitter(int index);
     void setCurrentEmitter(int index);
 
+    // Group is placed at the default position with the next color
+    void addGroup(const EmitterGroup &group);
+    void removeGroup(int index);
+    void setCurrentGroup(int index);
+
+    // Following changes are not merged with the previous ones, e.g. when
+    // the editing of a control has finished
+    void beginEdit();
+
 signals:
     void currentEmitterChanged(int index);
+    void currentGroupChanged(int index);
+
+    void emittersInserted(int index, int count);
+    void emittersRemoved(int index, int count);
+    void groupInserted(int index);
+    void groupRemoved(int index);
+
+    void focalLengthChanged(int focalLength);
+    void thickLensChanged(const ThickLens &lens);
+
+    // Aperture or the rays going through it have changed
+    void apertureChanged(const ApertureStatistics &statistics);
+    void objectMoved();
 
 protected:
     void paintEvent(QPaintEvent *event);
@@ -59,29 +144,90 @@ protected:
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
+    void leaveEvent(QEvent *event);
+
+private slots:
+    void updateAperture();
 
 private:
-    void paintAxis(QPainter &p);
-    void paintLens(QPainter &p);
-    void paintEmitter(QPainter &p, const QPoint &pos, bool selected);
-    void paintRay(QPainter &p, const RayEmitter &emitter);
+    // Gives the renderer the current scene and view
+    void setUpRenderer(SceneRenderer &renderer) const;
 
     inline QPoint cartesianToInternal(const QPointF &point);
     inline QPointF internalToCartesian(const QPoint &point);
 
+    // Merge key for a change made with the control (EditControl). Changes
+    // made with one control in a row share it until beginEdit() or a pause.
+    int controlMergeKey(int control);
+
+    // Records the change of the current emitter
+    void editCurrentEmitter(const RayEmitter &emitter, int mergeKey);
+
+    // Marks rays to be retraced in the index before the next query. The
+    // index is built again if the rays were added or removed.
+    void invalidateRays(int first, int count);
+    void invalidateAllRays(bool structure);
+
+    // Rays from first on were added, removed or moved to other indices
+    void invalidateRaysFrom(int first);
+    void updateRayIndex();
+
+    int groupFirstRay(int index) const;
+
+    // Highlights the ray under the cursor and shows where it comes from
+    void hoverAt(const QPoint &pos, const QPoint &globalPos);
+
     QList<RayEmitter> m_emitters;
     qreal m_focalLength;
 
+    SceneRenderer::LensMode m_lensMode;
+    ThickLens m_thickLens;
+    Dispersion m_dispersion;
+
+    QImage m_objectImage;
+    QRectF m_objectRect;
+
     QPoint m_offset;
     qreal m_scalingFactor;
 
     int m_currentEmitter;
 
+    QList<EmitterGroup> m_groups;
+    int m_currentGroup;
+
     bool m_dragging;
     bool m_draggingEmitter;
+    bool m_draggingGroup;
+    bool m_draggingObject;
+    bool m_drawingAperture;
     QPoint m_lastMousePos;
 
     int m_lastColor;
+
+    SceneRenderer m_renderer;
+
+    EditJournal *m_journal;
+
+    // Edits of one mouse drag or key repeat share the key
+    int m_mergeKey;
+
+    // Control which made the last edit and when
+    int m_editControl;
+    QElapsedTimer m_editTimer;
+
+    RaySegmentIndex m_rayIndex;
+    bool m_rebuildRayIndex;
+
+    // Rays to retrace, m_dirtyEnd is 0 if none
+    int m_dirtyFirst;
+    int m_dirtyEnd;
+
+    int m_hoveredRay;
+
+    QLineF m_aperture;
+
+    // Gathers the changes of one event into a single update of the aperture
+    QTimer *m_apertureTimer;
 };
 
 #endif // RENDERWIDGET_H
@@ -0,0 +1,928 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "scenerenderer.h"
+#include "raytracer.h"
+#include "spectraltracer.h"
+#include "imagemapper.h"
+
+#include <QPainter>
+#include <QBrush>
+#include <QImage>
+
+#include <qmath.h>
+#include <qnumeric.h>
+
+const int kEmitterRadius = 5;
+const qreal kDefaultScalingFactor = 10.0;
+
+// Rays are drawn up to this distance if the lens has no optical power
+const qreal kNoPowerRayLength = 1000.0;
+
+const QRgb kSpectralBackground = 0xff141414;
+
+// Group rays are expanded, traced and drawn this many at a time
+const int kGroupBatchSize = 16384;
+
+const QColor kHighlightColor(255, 170, 0, 160);
+const int kHighlightWidth = 6;
+
+SceneRenderer::SceneRenderer() :
+    m_focalLength(0.0),
+    m_currentEmitter(-1),
+    m_currentGroup(-1),
+    m_highlightedRay(-1),
+    m_lensMode(ThinLensMode),
+    m_spectralLeanMode(true),
+    m_offset(0, 0),
+    m_scalingFactor(kDefaultScalingFactor),
+    m_objectMapSource(0),
+    m_objectMapFocalLength(0.0),
+    m_objectMapScale(0.0)
+{
+}
+
+QList<RayEmitter> SceneRenderer::emitters() const
+{
+    return m_emitters;
+}
+
+void SceneRenderer::setEmitters(const QList<RayEmitter> &emitters)
+{
+    m_emitters = emitters;
+}
+
+qreal SceneRenderer::focalLength() const
+{
+    return m_focalLength;
+}
+
+void SceneRenderer::setFocalLength(qreal len)
+{
+    m_focalLength = len;
+}
+
+SceneRenderer::LensMode SceneRenderer::lensMode() const
+{
+    return m_lensMode;
+}
+
+void SceneRenderer::setLensMode(LensMode mode)
+{
+    m_lensMode = mode;
+}
+
+ThickLens SceneRenderer::thickLens() const
+{
+    return m_thickLens;
+}
+
+void SceneRenderer::setThickLens(const ThickLens &lens)
+{
+    m_thickLens = lens;
+}
+
+qreal SceneRenderer::effectiveFocalLength() const
+{
+    return m_lensMode == ThinLensMode ? m_focalLength : m_thickLens.focalLength();
+}
+
+Dispersion SceneRenderer::dispersion() const
+{
+    return m_dispersion;
+}
+
+void SceneRenderer::setDispersion(const Dispersion &dispersion)
+{
+    m_dispersion = dispersion;
+}
+
+QImage SceneRenderer::objectImage() const
+{
+    return m_objectImage;
+}
+
+void SceneRenderer::setObjectImage(const QImage &image)
+{
+    m_objectImage = image;
+}
+
+QRectF SceneRenderer::objectRect() const
+{
+    return m_objectRect;
+}
+
+void SceneRenderer::setObjectRect(const QRectF &rect)
+{
+    m_objectRect = rect;
+}
+
+QList<EmitterGroup> SceneRenderer::groups() const
+{
+    return m_groups;
+}
+
+void SceneRenderer::setGroups(const QList<EmitterGroup> &groups)
+{
+    m_groups = groups;
+}
+
+int SceneRenderer::currentGroup() const
+{
+    return m_currentGroup;
+}
+
+void SceneRenderer::setCurrentGroup(int index)
+{
+    m_currentGroup = index;
+}
+
+bool SceneRenderer::spectralLeanMode() const
+{
+    return m_spectralLeanMode;
+}
+
+void SceneRenderer::setSpectralLeanMode(bool lean)
+{
+    m_spectralLeanMode = lean;
+}
+
+int SceneRenderer::highlightedRay() const
+{
+    return m_highlightedRay;
+}
+
+void SceneRenderer::setHighlightedRay(int ray)
+{
+    m_highlightedRay = ray;
+}
+
+QLineF SceneRenderer::aperture() const
+{
+    return m_aperture;
+}
+
+void SceneRenderer::setAperture(const QLineF &aperture)
+{
+    m_aperture = aperture;
+}
+
+int SceneRenderer::rayCount() const
+{
+    int count = m_emitters.size();
+
+    for (int i = 0; i < m_groups.size(); i++) {
+        count += m_groups.at(i).rayCount();
+    }
+
+    return count;
+}
+
+namespace {
+
+// Flat or afocal lenses have no focal points to draw
+inline bool hasFocus(qreal focalLength)
+{
+    return focalLength != 0.0 && qIsFinite(focalLength);
+}
+
+inline qreal rayLength(qreal focalLength)
+{
+    return hasFocus(focalLength) ? 20 * qAbs(focalLength) : kNoPowerRayLength;
+}
+
+// Point where the ray leaves the rect, or the start if it is already out
+QPointF exitPoint(const QRectF &rect, const QPointF &start, const QPointF &dir)
+{
+    qreal t = -1.0;
+
+    if (dir.x() != 0.0) {
+        t = ((dir.x() > 0 ? rect.right() : rect.left()) - start.x()) / dir.x();
+    }
+
+    if (dir.y() != 0.0) {
+        qreal ty = ((dir.y() > 0 ? rect.bottom() : rect.top()) - start.y()) / dir.y();
+        t = dir.x() != 0.0 ? qMin(t, ty) : ty;
+    }
+
+    return start + dir * qMax(t, 0.0);
+}
+
+inline void setSegment(RaySegment &s, qreal x1, qreal y1, qreal x2, qreal y2)
+{
+    s.x1 = static_cast<float>(x1);
+    s.y1 = static_cast<float>(y1);
+    s.x2 = static_cast<float>(x2);
+    s.y2 = static_cast<float>(y2);
+}
+
+}
+
+void SceneRenderer::traceSegments(int first, int count, RaySegment *segments) const
+{
+    RayBatch rays;
+    rayBatch(first, count, rays);
+
+    if (m_lensMode == ThinLensMode) {
+        qreal focalLength = effectiveFocalLength();
+        qreal infX = rayLength(focalLength);
+
+        for (int i = 0; i < rays.size(); i++) {
+            RaySegment *s = segments + i * kSegmentsPerRay;
+
+            qreal x = rays.x.at(i);
+            qreal y = rays.y.at(i);
+            qreal dx = rays.dx.at(i);
+            qreal dy = rays.dy.at(i);
+
+            // Going away from the lens
+            if (dx <= 0.0) {
+                QPointF end = QPointF(x, y) + QPointF(dx, dy) * kNoPowerRayLength;
+
+                setSegment(s[0], x, y, end.x(), end.y());
+                setSegment(s[1], end.x(), end.y(), end.x(), end.y());
+                setSegment(s[2], end.x(), end.y(), end.x(), end.y());
+                continue;
+            }
+
+            qreal slope = dy / dx;
+            qreal lensY = y - slope * x;
+
+            // The refracted ray passes through the focal plane point of the
+            // parallel ray through the optical center
+            qreal newSlope = focalLength == 0.0 ? slope : slope - lensY / focalLength;
+            qreal infY = lensY + newSlope * infX;
+
+            setSegment(s[0], x, y, 0.0, lensY);
+            setSegment(s[1], 0.0, lensY, infX, infY);
+            setSegment(s[2], infX, infY, infX, infY);
+        }
+
+        return;
+    }
+
+    ThickLensTraceBatch trace;
+    traceThickLens(m_thickLens, rays, trace);
+
+    qreal infX = rayLength(m_thickLens.focalLength());
+
+    // Rays which do not pass are continued by a fixed length, since the
+    // index does not depend on the view
+    qreal length = qMax(infX, kNoPowerRayLength);
+
+    for (int i = 0; i < trace.size(); i++) {
+        RaySegment *s = segments + i * kSegmentsPerRay;
+
+        qreal x1 = trace.x1.at(i);
+        qreal y1 = trace.y1.at(i);
+        qreal x2 = trace.x2.at(i);
+        qreal y2 = trace.y2.at(i);
+
+        setSegment(s[0], rays.x.at(i), rays.y.at(i), x1, y1);
+
+        switch (trace.status.at(i)) {
+        case ThickLensTraceBatch::Passed: {
+            qreal dx = trace.dx2.at(i);
+            qreal dy = trace.dy2.at(i);
+            qreal t = dx > 0 ? (infX - x2) / dx : kNoPowerRayLength;
+
+            setSegment(s[1], x1, y1, x2, y2);
+            setSegment(s[2], x2, y2, x2 + dx * t, y2 + dy * t);
+            break;
+        }
+        case ThickLensTraceBatch::TotalReflection:
+            setSegment(s[1], x1, y1, x2, y2);
+            setSegment(s[2], x2, y2, x2 + trace.dx2.at(i) * length,
+                       y2 + trace.dy2.at(i) * length);
+            break;
+        case ThickLensTraceBatch::MissedFront:
+            setSegment(s[1], x1, y1, x1 + rays.dx.at(i) * length,
+                       y1 + rays.dy.at(i) * length);
+            setSegment(s[2], s[1].x2, s[1].y2, s[1].x2, s[1].y2);
+            break;
+        default:
+            setSegment(s[1], x1, y1, x1 + trace.dx1.at(i) * length,
+                       y1 + trace.dy1.at(i) * length);
+            setSegment(s[2], s[1].x2, s[1].y2, s[1].x2, s[1].y2);
+            break;
+        }
+    }
+}
+
+int SceneRenderer::currentEmitter() const
+{
+    return m_currentEmitter;
+}
+
+void SceneRenderer::setCurrentEmitter(int index)
+{
+    m_currentEmitter = index;
+}
+
+QSize SceneRenderer::size() const
+{
+    return m_size;
+}
+
+void SceneRenderer::setSize(const QSize &size)
+{
+    m_size = size;
+}
+
+QPoint SceneRenderer::offset() const
+{
+    return m_offset;
+}
+
+void SceneRenderer::setOffset(const QPoint &offset)
+{
+    m_offset = offset;
+}
+
+qreal SceneRenderer::scalingFactor() const
+{
+    return m_scalingFactor;
+}
+
+void SceneRenderer::setScalingFactor(qreal factor)
+{
+    m_scalingFactor = factor;
+}
+
+QPoint SceneRenderer::cartesianToInternal(const QPointF &point) const
+{
+    QPoint newPoint((m_size.width() / 2) + point.x() * m_scalingFactor,
+                    (m_size.height() / 2) - point.y() * m_scalingFactor);
+
+    return newPoint;
+}
+
+QPointF SceneRenderer::internalToCartesian(const QPoint &point) const
+{
+    QPointF newPoint((point.x() - m_size.width() / 2) / m_scalingFactor,
+                     (m_size.height() / 2 - point.y()) / m_scalingFactor);
+    return newPoint;
+}
+
+QRectF SceneRenderer::visibleRect() const
+{
+    return QRectF(internalToCartesian(-m_offset),
+                  internalToCartesian(QPoint(m_size.width(), m_size.height()) - m_offset))
+            .normalized();
+}
+
+void SceneRenderer::render(QPainter &p) const
+{
+    QList<RayEmitter> monochromatic;
+    QList<RayEmitter> polychromatic;
+
+    for (int i = 0; i < m_emitters.size(); i++) {
+        if (!m_emitters.at(i).spectrum().isMonochromatic()) {
+            polychromatic.append(m_emitters.at(i));
+        }
+    }
+
+    if (polychromatic.isEmpty()) {
+        monochromatic = m_emitters;
+    } else {
+        for (int i = 0; i < m_emitters.size(); i++) {
+            if (m_emitters.at(i).spectrum().isMonochromatic()) {
+                monochromatic.append(m_emitters.at(i));
+            }
+        }
+    }
+
+    // Additively composed colors are only visible on a dark background
+    QColor foreground = polychromatic.isEmpty() ? Qt::black : Qt::lightGray;
+
+    p.save();
+
+    p.translate(m_offset);
+    p.setRenderHint(QPainter::Antialiasing, true);
+
+    if (!polychromatic.isEmpty()) {
+        p.fillRect(QRect(-m_offset, m_size), QColor(kSpectralBackground));
+    }
+
+    if (!m_objectImage.isNull()) {
+        paintObject(p);
+    }
+
+    p.setPen(foreground);
+
+    paintAxis(p);
+
+    if (m_lensMode == ThinLensMode) {
+        paintLens(p, foreground);
+    } else {
+        paintThickLens(p, foreground);
+    }
+
+    if (hasThinLensRays()) {
+        p.save();
+
+        if (m_lensMode == CompareMode) {
+            p.setOpacity(0.3);
+        }
+
+        for (int i = 0; i < monochromatic.size(); i++) {
+            paintRay(p, monochromatic.at(i), effectiveFocalLength());
+        }
+
+        p.restore();
+    }
+
+    if (m_lensMode != ThinLensMode) {
+        paintThickLensRays(p, monochromatic);
+    }
+
+    if (!polychromatic.isEmpty()) {
+        paintSpectralRays(p, polychromatic);
+    }
+
+    for (int i = 0; i < m_groups.size(); i++) {
+        paintGroup(p, m_groups.at(i));
+    }
+
+    if (m_highlightedRay >= 0 && m_highlightedRay < rayCount()) {
+        paintHighlightedRay(p);
+    }
+
+    if (!m_aperture.isNull()) {
+        paintAperture(p, foreground);
+    }
+
+    for (int i = 0; i < m_emitters.size(); i++) {
+        paintEmitter(p, cartesianToInternal(m_emitters.at(i).pos()), i == m_currentEmitter);
+    }
+
+    for (int i = 0; i < m_groups.size(); i++) {
+        paintGroupMarker(p, cartesianToInternal(m_groups.at(i).pos()), i == m_currentGroup);
+    }
+
+    p.restore();
+}
+
+bool SceneRenderer::hasThinLensRays() const
+{
+    // The overlay of a flat or afocal thick lens would divide by zero
+    return m_lensMode == ThinLensMode
+            || (m_lensMode == CompareMode && hasFocus(effectiveFocalLength()));
+}
+
+void SceneRenderer::paintAxis(QPainter &p) const
+{
+    int axisY = m_size.height() / 2;
+    p.drawLine(-m_offset.x(), axisY, m_size.width() - m_offset.x(), axisY);
+
+    // Focuses
+    qreal focalLength = effectiveFocalLength();
+
+    if (!qIsFinite(focalLength)) {
+        return;
+    }
+
+    QPoint tick1 = cartesianToInternal(QPointF(focalLength, 0));
+    QPoint tick2 = cartesianToInternal(QPointF(-focalLength, 0));
+
+    const int tickHeight = 10;
+
+    p.drawLine(tick1.x(), tick1.y() + tickHeight,
+               tick1.x(), tick1.y() - tickHeight);
+
+    p.drawLine(tick2.x(), tick2.y() + tickHeight,
+               tick2.x(), tick2.y() - tickHeight);
+
+    // Focal planes
+    p.save();
+
+    // Keeps the foreground color, which contrasts with the background
+    QPen pen = p.pen();
+    pen.setStyle(Qt::DashLine);
+    p.setPen(pen);
+
+    p.drawLine(tick1.x(), -m_offset.y(), tick1.x(), m_size.height() - m_offset.y());
+    p.drawLine(tick2.x(), -m_offset.y(), tick2.x(), m_size.height() - m_offset.y());
+
+    p.restore();
+}
+
+void SceneRenderer::paintLens(QPainter &p, const QColor &color) const
+{
+    const int offset = 40;
+    const int capWidth = 20;
+
+    const int width = m_size.width();
+    const int height = m_size.height();
+
+    p.save();
+
+    p.setPen(QPen(QBrush(color), 2));
+
+    p.drawLine(width / 2, offset,
+               width / 2, height - offset);
+
+    if (m_focalLength > 0) {
+        p.drawLine(width / 2, offset,
+                   width / 2 - capWidth, offset + capWidth);
+
+        p.drawLine(width / 2, offset,
+                   width / 2 + capWidth, offset + capWidth);
+
+        p.drawLine(width / 2, height - offset,
+                   width / 2 - capWidth,
+                   height - offset - capWidth);
+
+        p.drawLine(width / 2, height - offset,
+                   width / 2 + capWidth,
+                   height - offset - capWidth);
+    } else {
+        p.drawLine(width / 2, offset,
+                   width / 2 - capWidth, offset - capWidth);
+
+        p.drawLine(width / 2, offset,
+                   width / 2 + capWidth, offset - capWidth);
+
+        p.drawLine(width / 2, height - offset,
+                   width / 2 - capWidth,
+                   height - offset + capWidth);
+
+        p.drawLine(width / 2, height - offset,
+                   width / 2 + capWidth,
+                   height - offset + capWidth);
+    }
+
+    p.restore();
+}
+
+void SceneRenderer::paintEmitter(QPainter &p, const QPoint &pos, bool selected) const
+{
+    p.save();
+
+    p.setPen(QPen(QBrush(Qt::red), 1));
+
+    if (selected) {
+        p.setBrush(QBrush(Qt::green));
+    } else {
+        p.setBrush(QBrush(Qt::red));
+    }
+
+    p.drawEllipse(pos, kEmitterRadius, kEmitterRadius);
+
+    p.restore();
+}
+
+void SceneRenderer::paintRay(QPainter &p, const RayEmitter &emitter,
+                             qreal focalLength) const
+{
+    p.save();
+
+    p.setPen(QPen(QBrush(emitter.color()), 2));
+
+    ThinLensTrace trace = traceThinLens(emitter, focalLength);
+
+    QPointF lensIntersect = trace.lensIntersect;
+    QPointF focalPlaneIntersect = trace.focalPlaneIntersect;
+    qreal newSlope = trace.slope;
+
+    qreal infX = 20 * qAbs(focalLength);
+    QPointF inf = QPointF(infX, newSlope * infX + lensIntersect.y());
+
+    QPolygon ray;
+
+    ray << cartesianToInternal(emitter.pos())
+        << cartesianToInternal(lensIntersect);
+
+    if (focalLength > 0) {
+        ray << cartesianToInternal(focalPlaneIntersect);
+    } else {
+        p.save();
+
+        p.setPen(QPen(QBrush(emitter.color()), 1, Qt::DashLine));
+        p.drawLine(cartesianToInternal(lensIntersect),
+                   cartesianToInternal(focalPlaneIntersect));
+
+        p.restore();
+    }
+
+    ray << cartesianToInternal(inf);
+
+    p.drawPolyline(ray);
+
+    p.restore();
+}
+
+void SceneRenderer::paintThickLens(QPainter &p, const QColor &color) const
+{
+    const int steps = 32;
+
+    qreal aperture = m_thickLens.aperture();
+
+    QPolygonF profile;
+
+    for (int i = 0; i <= steps; i++) {
+        qreal y = aperture - 2 * aperture * i / steps;
+        profile << cartesianToInternal(QPointF(m_thickLens.frontVertex()
+                                               + m_thickLens.frontSag(y), y));
+    }
+
+    for (int i = 0; i <= steps; i++) {
+        qreal y = -aperture + 2 * aperture * i / steps;
+        profile << cartesianToInternal(QPointF(m_thickLens.backVertex()
+                                               + m_thickLens.backSag(y), y));
+    }
+
+    p.save();
+
+    p.setPen(QPen(QBrush(color), 2));
+    p.setBrush(QColor(160, 200, 255, 80));
+    p.drawPolygon(profile);
+
+    p.restore();
+}
+
+void SceneRenderer::paintThickLensRays(QPainter &p,
+                                       const QList<RayEmitter> &emitters) const
+{
+    RayBatch rays;
+    rays.resize(emitters.size());
+
+    QVector<QRgb> colors(emitters.size());
+
+    for (int i = 0; i < emitters.size(); i++) {
+        const RayEmitter &em = emitters.at(i);
+
+        rays.x[i] = em.pos().x();
+        rays.y[i] = em.pos().y();
+        rays.dx[i] = qCos(em.angle());
+        rays.dy[i] = qSin(em.angle());
+
+        colors[i] = em.color().rgb();
+    }
+
+    paintThickLensRays(p, rays, colors);
+}
+
+void SceneRenderer::paintThickLensRays(QPainter &p, const RayBatch &rays,
+                                       const QVector<QRgb> &colors) const
+{
+    ThickLensTraceBatch trace;
+    traceThickLens(m_thickLens, rays, trace);
+
+    qreal infX = rayLength(m_thickLens.focalLength());
+    QRectF visible = visibleRect();
+
+    p.save();
+
+    for (int i = 0; i < trace.size(); i++) {
+        if (i == 0 || (colors.size() > 1 && colors.at(i) != colors.at(i - 1))) {
+            p.setPen(QPen(QBrush(QColor(colors.at(colors.size() > 1 ? i : 0))), 2));
+        }
+
+        QPolygon ray;
+
+        ray << cartesianToInternal(QPointF(rays.x.at(i), rays.y.at(i)))
+            << cartesianToInternal(QPointF(trace.x1.at(i), trace.y1.at(i)));
+
+        switch (trace.status.at(i)) {
+        case ThickLensTraceBatch::Passed: {
+            QPointF exit(trace.x2.at(i), trace.y2.at(i));
+            qreal dx = trace.dx2.at(i);
+            qreal dy = trace.dy2.at(i);
+
+            qreal t = dx > 0 ? (infX - exit.x()) / dx : kNoPowerRayLength;
+
+            ray << cartesianToInternal(exit)
+                << cartesianToInternal(exit + QPointF(dx, dy) * t);
+            break;
+        }
+        case ThickLensTraceBatch::TotalReflection: {
+            QPointF reflection(trace.x2.at(i), trace.y2.at(i));
+            QPointF dir(trace.dx2.at(i), trace.dy2.at(i));
+
+            ray << cartesianToInternal(reflection)
+                << cartesianToInternal(exitPoint(visible, reflection, dir));
+            break;
+        }
+        case ThickLensTraceBatch::MissedFront: {
+            // Outside of the aperture the ray goes on unchanged
+            QPointF dir(rays.dx.at(i), rays.dy.at(i));
+
+            ray << cartesianToInternal(exitPoint(visible, QPointF(trace.x1.at(i),
+                                                                  trace.y1.at(i)), dir));
+            break;
+        }
+        default: {
+            // Leaves the glass through the rim
+            QPointF dir(trace.dx1.at(i), trace.dy1.at(i));
+
+            ray << cartesianToInternal(exitPoint(visible, QPointF(trace.x1.at(i),
+                                                                  trace.y1.at(i)), dir));
+            break;
+        }
+        }
+
+        p.drawPolyline(ray);
+    }
+
+    p.restore();
+}
+
+void SceneRenderer::paintSpectralRays(QPainter &p,
+                                      const QList<RayEmitter> &emitters) const
+{
+    SpectralTracer tracer;
+    tracer.setDispersion(m_dispersion);
+    tracer.setLeanMode(m_spectralLeanMode);
+    tracer.setVisibleRect(visibleRect());
+
+    if (m_lensMode == ThinLensMode) {
+        tracer.traceThinLens(emitters, m_focalLength);
+    } else {
+        tracer.traceThickLens(emitters, m_thickLens);
+    }
+
+    // Sub-rays are added up in a separate layer, so that the wavelengths
+    // which meet again give back white
+    QImage layer(m_size, QImage::Format_ARGB32_Premultiplied);
+    layer.fill(0);
+
+    QPainter lp(&layer);
+    lp.translate(m_offset);
+    lp.setRenderHint(QPainter::Antialiasing, true);
+    lp.setCompositionMode(QPainter::CompositionMode_Plus);
+
+    const QVector<SpectralSegment> &segments = tracer.segments();
+
+    for (int i = 0; i < segments.size(); i++) {
+        const SpectralSegment &seg = segments.at(i);
+
+        lp.setPen(QPen(QBrush(QColor(seg.color)), 2));
+        lp.drawLine(cartesianToInternal(QPointF(seg.x1, seg.y1)),
+                    cartesianToInternal(QPointF(seg.x2, seg.y2)));
+    }
+
+    lp.end();
+
+    p.drawImage(-m_offset, layer);
+}
+
+void SceneRenderer::paintObject(QPainter &p) const
+{
+    QRect target(cartesianToInternal(m_objectRect.topLeft()),
+                 cartesianToInternal(m_objectRect.bottomRight()));
+
+    p.drawImage(target.normalized(), m_objectImage);
+
+    QPointF origin = internalToCartesian(-m_offset);
+
+    if (m_objectMap.size() != m_size
+            || m_objectMapSource != m_objectImage.cacheKey()
+            || m_objectMapRect != m_objectRect
+            || m_objectMapFocalLength != effectiveFocalLength()
+            || m_objectMapOrigin != origin
+            || m_objectMapScale != m_scalingFactor) {
+        ImageMapper mapper;
+        mapper.setSource(m_objectImage);
+        mapper.setObjectRect(m_objectRect);
+        mapper.setFocalLength(effectiveFocalLength());
+        mapper.setView(m_size, origin, m_scalingFactor);
+
+        m_objectMap = mapper.map();
+        m_objectMapSource = m_objectImage.cacheKey();
+        m_objectMapRect = m_objectRect;
+        m_objectMapFocalLength = effectiveFocalLength();
+        m_objectMapOrigin = origin;
+        m_objectMapScale = m_scalingFactor;
+    }
+
+    p.drawImage(-m_offset, m_objectMap);
+}
+
+void SceneRenderer::paintGroup(QPainter &p, const EmitterGroup &group) const
+{
+    if (hasThinLensRays()) {
+        p.save();
+
+        if (m_lensMode == CompareMode) {
+            p.setOpacity(0.3);
+        }
+
+        // Rays of the instances are computed one by one and never stored
+        for (int i = 0; i < group.instances().size(); i++) {
+            for (int j = 0; j < group.prototype().size(); j++) {
+                paintRay(p, group.emitterAt(i, j), effectiveFocalLength());
+            }
+        }
+
+        p.restore();
+    }
+
+    if (m_lensMode != ThinLensMode) {
+        RayBatch rays;
+        QVector<QRgb> color(1, group.color().rgb());
+
+        for (int first = 0; first < group.rayCount(); first += kGroupBatchSize) {
+            rays.resize(0);
+            group.expand(rays, first, qMin(kGroupBatchSize, group.rayCount() - first));
+
+            paintThickLensRays(p, rays, color);
+        }
+    }
+}
+
+void SceneRenderer::paintGroupMarker(QPainter &p, const QPoint &pos, bool selected) const
+{
+    p.save();
+
+    p.setPen(QPen(QBrush(Qt::red), 1));
+    p.setBrush(QBrush(selected ? Qt::green : Qt::red));
+
+    p.drawRect(pos.x() - kEmitterRadius, pos.y() - kEmitterRadius,
+               2 * kEmitterRadius, 2 * kEmitterRadius);
+
+    p.restore();
+}
+
+void SceneRenderer::paintHighlightedRay(QPainter &p) const
+{
+    RaySegment segments[kSegmentsPerRay];
+    traceSegments(m_highlightedRay, 1, segments);
+
+    QPolygon ray;
+    ray << cartesianToInternal(QPointF(segments[0].x1, segments[0].y1));
+
+    for (int i = 0; i < kSegmentsPerRay; i++) {
+        ray << cartesianToInternal(QPointF(segments[i].x2, segments[i].y2));
+    }
+
+    p.save();
+
+    p.setPen(QPen(QBrush(kHighlightColor), kHighlightWidth, Qt::SolidLine, Qt::RoundCap));
+    p.drawPolyline(ray);
+
+    p.restore();
+}
+
+void SceneRenderer::paintAperture(QPainter &p, const QColor &color) const
+{
+    p.save();
+
+    p.setPen(QPen(QBrush(color), 4, Qt::SolidLine, Qt::FlatCap));
+    p.drawLine(cartesianToInternal(m_aperture.p1()), cartesianToInternal(m_aperture.p2()));
+
+    p.restore();
+}
+
+void SceneRenderer::rayBatch(int first, int count, RayBatch &rays) const
+{
+    int end = first + count;
+
+    // Rays of the emitters
+    for (int i = qMax(first, 0); i < qMin(end, m_emitters.size()); i++) {
+        const RayEmitter &em = m_emitters.at(i);
+        int k = rays.size();
+
+        rays.resize(k + 1);
+        rays.x[k] = em.pos().x();
+        rays.y[k] = em.pos().y();
+        rays.dx[k] = qCos(em.angle());
+        rays.dy[k] = qSin(em.angle());
+    }
+
+    // Then the requested part of each group
+    int start = m_emitters.size();
+
+    for (int i = 0; i < m_groups.size() && start < end; i++) {
+        const EmitterGroup &group = m_groups.at(i);
+        int groupEnd = start + group.rayCount();
+
+        int from = qMax(first, start);
+        int to = qMin(end, groupEnd);
+
+        if (from < to) {
+            group.expand(rays, from - start, to - from);
+        }
+
+        start = groupEnd;
+    }
+}
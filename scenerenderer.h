@@ -0,0 +1,194 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include <QList>
+#include <QImage>
+#include <QPoint>
+#include <QRectF>
+#include <QLineF>
+#include <QSize>
+
+#include "rayemitter.h"
+#include "thicklens.h"
+#include "spectrum.h"
+#include "emittergroup.h"
+#include "raysegmentindex.h"
+
+class QPainter;
+
+// Draws the optical axis, the lens, emitters and their rays. Holds only
+// copies of the scene, so it can be used outside of the GUI thread to
+// render frames offscreen.
+class SceneRenderer
+{
+public:
+    enum LensMode {
+        // Every ray is bent towards the focal plane point of its direction
+        ThinLensMode,
+        // Exact refraction on the surfaces of a ThickLens
+        ThickLensMode,
+        // Thick lens rays over the thin lens ones with the same focal length
+        CompareMode
+    };
+
+    SceneRenderer();
+
+    QList<RayEmitter> emitters() const;
+    void setEmitters(const QList<RayEmitter> &emitters);
+
+    // Focal length of the thin lens
+    qreal focalLength() const;
+    void setFocalLength(qreal len);
+
+    LensMode lensMode() const;
+    void setLensMode(LensMode mode);
+
+    ThickLens thickLens() const;
+    void setThickLens(const ThickLens &lens);
+
+    // Focal length of the lens currently displayed
+    qreal effectiveFocalLength() const;
+
+    // Dispersion of the lens glass, applies to polychromatic emitters
+    Dispersion dispersion() const;
+    void setDispersion(const Dispersion &dispersion);
+
+    // Picture on the object side of the lens which is imaged by it. Null
+    // image if there is none.
+    QImage objectImage() const;
+    void setObjectImage(const QImage &image);
+
+    QRectF objectRect() const;
+    void setObjectRect(const QRectF &rect);
+
+    // Keep traced sub-rays of polychromatic emitters only where they are
+    // visible. On by default.
+    bool spectralLeanMode() const;
+    void setSpectralLeanMode(bool lean);
+
+    // Index of the highlighted emitter, -1 if none
+    int currentEmitter() const;
+    void setCurrentEmitter(int index);
+
+    QList<EmitterGroup> groups() const;
+    void setGroups(const QList<EmitterGroup> &groups);
+
+    // Index of the highlighted group, -1 if none
+    int currentGroup() const;
+    void setCurrentGroup(int index);
+
+    // Ray drawn over the others, -1 if none
+    int highlightedRay() const;
+    void setHighlightedRay(int ray);
+
+    // Line drawn by the user to measure the rays going through it, null if
+    // there is none
+    QLineF aperture() const;
+    void setAperture(const QLineF &aperture);
+
+    // Rays of the emitters followed by the rays of every group
+    int rayCount() const;
+
+    // Appends rays first .. first + count - 1 to the batch
+    void rayBatch(int first, int count, RayBatch &rays) const;
+
+    // Fills count * kSegmentsPerRay segments of the rays starting at first,
+    // as they are drawn in the current lens mode. Polychromatic emitters are
+    // traced without dispersion.
+    void traceSegments(int first, int count, RaySegment *segments) const;
+
+    // Size of the paint device in pixels
+    QSize size() const;
+    void setSize(const QSize &size);
+
+    // Translation of the view in pixels
+    QPoint offset() const;
+    void setOffset(const QPoint &offset);
+
+    // Pixels per unit of length
+    qreal scalingFactor() const;
+    void setScalingFactor(qreal factor);
+
+    void render(QPainter &p) const;
+
+    QPoint cartesianToInternal(const QPointF &point) const;
+    QPointF internalToCartesian(const QPoint &point) const;
+
+    // Part of the plane shown, in cartesian coordinates
+    QRectF visibleRect() const;
+
+private:
+    // Whether the thin lens rays are drawn, alone or over the thick lens
+    bool hasThinLensRays() const;
+
+    void paintAxis(QPainter &p) const;
+    void paintLens(QPainter &p, const QColor &color) const;
+    void paintEmitter(QPainter &p, const QPoint &pos, bool selected) const;
+    void paintRay(QPainter &p, const RayEmitter &emitter, qreal focalLength) const;
+    void paintThickLens(QPainter &p, const QColor &color) const;
+    void paintThickLensRays(QPainter &p, const QList<RayEmitter> &emitters) const;
+    // One color per ray, or a single one for all of them
+    void paintThickLensRays(QPainter &p, const RayBatch &rays,
+                            const QVector<QRgb> &colors) const;
+    void paintSpectralRays(QPainter &p, const QList<RayEmitter> &emitters) const;
+    void paintObject(QPainter &p) const;
+    void paintGroup(QPainter &p, const EmitterGroup &group) const;
+    void paintGroupMarker(QPainter &p, const QPoint &pos, bool selected) const;
+    void paintHighlightedRay(QPainter &p) const;
+    void paintAperture(QPainter &p, const QColor &color) const;
+
+    QList<RayEmitter> m_emitters;
+    qreal m_focalLength;
+    int m_currentEmitter;
+
+    QList<EmitterGroup> m_groups;
+    int m_currentGroup;
+
+    int m_highlightedRay;
+    QLineF m_aperture;
+
+    LensMode m_lensMode;
+    ThickLens m_thickLens;
+    Dispersion m_dispersion;
+    bool m_spectralLeanMode;
+
+    QImage m_objectImage;
+    QRectF m_objectRect;
+
+    QSize m_size;
+    QPoint m_offset;
+    qreal m_scalingFactor;
+
+    // Object picture mapped through the lens, kept while the picture, the
+    // lens and the view stay the same
+    mutable QImage m_objectMap;
+    mutable qint64 m_objectMapSource;
+    mutable QRectF m_objectMapRect;
+    mutable qreal m_objectMapFocalLength;
+    mutable QPointF m_objectMapOrigin;
+    mutable qreal m_objectMapScale;
+};
+
+#endif // SCENERENDERER_H
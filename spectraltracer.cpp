@@ -0,0 +1,297 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "spectraltracer.h"
+
+#include <QMap>
+#include <qmath.h>
+#include <qnumeric.h>
+
+// Rays are drawn up to this distance if the lens has no optical power
+const qreal kNoPowerRayLength = 1000.0;
+
+// Clips the segment to the rect (Liang-Barsky). Returns false if the
+// segment lies outside of it.
+static bool clipSegment(const QRectF &rect, QPointF &a, QPointF &b)
+{
+    qreal t0 = 0.0;
+    qreal t1 = 1.0;
+
+    qreal dx = b.x() - a.x();
+    qreal dy = b.y() - a.y();
+
+    const qreal p[4] = { -dx, dx, -dy, dy };
+    const qreal q[4] = { a.x() - rect.left(), rect.right() - a.x(),
+                         a.y() - rect.top(), rect.bottom() - a.y() };
+
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0.0) {
+            if (q[i] < 0) {
+                return false;
+            }
+
+            continue;
+        }
+
+        qreal t = q[i] / p[i];
+
+        if (p[i] < 0) {
+            t0 = qMax(t0, t);
+        } else {
+            t1 = qMin(t1, t);
+        }
+
+        if (t0 > t1) {
+            return false;
+        }
+    }
+
+    QPointF start = a;
+
+    a = start + QPointF(dx, dy) * t0;
+    b = start + QPointF(dx, dy) * t1;
+
+    return true;
+}
+
+SpectralTracer::SpectralTracer() :
+    m_leanMode(false)
+{
+}
+
+void SpectralTracer::setDispersion(const Dispersion &dispersion)
+{
+    m_dispersion = dispersion;
+}
+
+void SpectralTracer::setLeanMode(bool lean)
+{
+    m_leanMode = lean;
+}
+
+bool SpectralTracer::leanMode() const
+{
+    return m_leanMode;
+}
+
+void SpectralTracer::setVisibleRect(const QRectF &rect)
+{
+    m_visibleRect = rect.normalized();
+}
+
+const QVector<SpectralSegment>& SpectralTracer::segments() const
+{
+    return m_segments;
+}
+
+int SpectralTracer::samplesIndex(const Spectrum &spectrum)
+{
+    for (int i = 0; i < m_samples.size(); i++) {
+        const Spectrum &other = m_samples.at(i).spectrum;
+
+        if (other.samples() == spectrum.samples()
+                && other.minWavelength() == spectrum.minWavelength()
+                && other.maxWavelength() == spectrum.maxWavelength()) {
+            return i;
+        }
+    }
+
+    Samples samples;
+    samples.spectrum = spectrum;
+
+    for (int i = 0; i < spectrum.samples(); i++) {
+        samples.wavelengths.append(spectrum.wavelengthAt(i));
+        samples.colors.append(spectrum.colorAt(i));
+    }
+
+    m_samples.append(samples);
+    return m_samples.size() - 1;
+}
+
+void SpectralTracer::addSegment(const QPointF &a, const QPointF &b, QRgb color)
+{
+    QPointF start = a;
+    QPointF end = b;
+
+    if (m_leanMode && !clipSegment(m_visibleRect, start, end)) {
+        return;
+    }
+
+    SpectralSegment segment;
+    segment.x1 = start.x();
+    segment.y1 = start.y();
+    segment.x2 = end.x();
+    segment.y2 = end.y();
+    segment.color = color;
+
+    m_segments.append(segment);
+}
+
+void SpectralTracer::traceThinLens(const QList<RayEmitter> &emitters,
+                                   qreal focalLength)
+{
+    m_segments.clear();
+
+    const QRgb white = qRgb(255, 255, 255);
+    const qreal infX = 20 * qAbs(focalLength);
+
+    QVector<double> invFocal;
+    QVector<double> endY;
+
+    int lastSamples = -1;
+
+    for (int i = 0; i < emitters.size(); i++) {
+        const RayEmitter &em = emitters.at(i);
+
+        if (em.spectrum().isMonochromatic()) {
+            continue;
+        }
+
+        int index = samplesIndex(em.spectrum());
+        const Samples &samples = m_samples.at(index);
+        const int n = samples.wavelengths.size();
+
+        if (index != lastSamples) {
+            invFocal.resize(n);
+            endY.resize(n);
+
+            for (int k = 0; k < n; k++) {
+                invFocal[k] = 1.0 / m_dispersion.focalLength(samples.wavelengths.at(k),
+                                                              focalLength);
+            }
+
+            lastSamples = index;
+        }
+
+        double slope = em.slope();
+        double lensY = em.planeIntersection(0.0).y();
+
+        addSegment(em.pos(), QPointF(0.0, lensY), white);
+
+        // Each wavelength has its own focal plane; the ray through it keeps
+        // going with slope - lensY / f
+        const double *inv = invFocal.constData();
+        double *end = endY.data();
+
+        for (int k = 0; k < n; k++) {
+            end[k] = lensY + (slope - lensY * inv[k]) * infX;
+        }
+
+        for (int k = 0; k < n; k++) {
+            addSegment(QPointF(0.0, lensY), QPointF(infX, end[k]),
+                       samples.colors.at(k));
+        }
+    }
+}
+
+void SpectralTracer::traceThickLens(const QList<RayEmitter> &emitters,
+                                    const ThickLens &lens)
+{
+    m_segments.clear();
+
+    const QRgb white = qRgb(255, 255, 255);
+
+    qreal focalLength = lens.focalLength();
+    qreal infX = focalLength == 0.0 || !qIsFinite(focalLength)
+            ? kNoPowerRayLength : 20 * qAbs(focalLength);
+
+    // Rays which do not pass are continued up to this length
+    qreal length = qMax(infX, kNoPowerRayLength);
+
+    // Emitters with the same spectrum are traced together, one batch per
+    // wavelength
+    QMap<int, QList<int> > groups;
+
+    for (int i = 0; i < emitters.size(); i++) {
+        if (!emitters.at(i).spectrum().isMonochromatic()) {
+            groups[samplesIndex(emitters.at(i).spectrum())].append(i);
+        }
+    }
+
+    RayBatch rays;
+    ThickLensTraceBatch trace;
+
+    for (QMap<int, QList<int> >::const_iterator it = groups.constBegin();
+         it != groups.constEnd(); ++it) {
+        const Samples &samples = m_samples.at(it.key());
+        const QList<int> &group = it.value();
+
+        rays.resize(group.size());
+
+        for (int i = 0; i < group.size(); i++) {
+            const RayEmitter &em = emitters.at(group.at(i));
+
+            rays.x[i] = em.pos().x();
+            rays.y[i] = em.pos().y();
+            rays.dx[i] = qCos(em.angle());
+            rays.dy[i] = qSin(em.angle());
+        }
+
+        for (int k = 0; k < samples.wavelengths.size(); k++) {
+            ThickLens sampleLens = lens;
+            sampleLens.setRefractiveIndex(
+                        m_dispersion.refractiveIndex(samples.wavelengths.at(k),
+                                                     lens.refractiveIndex()));
+
+            ::traceThickLens(sampleLens, rays, trace);
+
+            QRgb color = samples.colors.at(k);
+
+            for (int i = 0; i < trace.size(); i++) {
+                QPointF origin(rays.x.at(i), rays.y.at(i));
+                QPointF hit1(trace.x1.at(i), trace.y1.at(i));
+                QPointF hit2(trace.x2.at(i), trace.y2.at(i));
+                QPointF dir(trace.dx2.at(i), trace.dy2.at(i));
+
+                // The front surface is hit in the same point by every
+                // wavelength
+                if (k == 0) {
+                    addSegment(origin, hit1, white);
+                }
+
+                switch (trace.status.at(i)) {
+                case ThickLensTraceBatch::Passed: {
+                    qreal t = dir.x() > 0 ? (infX - hit2.x()) / dir.x() : kNoPowerRayLength;
+
+                    addSegment(hit1, hit2, color);
+                    addSegment(hit2, hit2 + dir * t, color);
+                    break;
+                }
+                case ThickLensTraceBatch::TotalReflection:
+                    addSegment(hit1, hit2, color);
+                    addSegment(hit2, hit2 + dir * length, color);
+                    break;
+                case ThickLensTraceBatch::MissedFront:
+                    if (k == 0) {
+                        addSegment(hit1, hit1 + QPointF(rays.dx.at(i), rays.dy.at(i))
+                                   * length, white);
+                    }
+                    break;
+                default:
+                    addSegment(hit1, hit1 + QPointF(trace.dx1.at(i), trace.dy1.at(i))
+                               * length, color);
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SPECTRALTRACER_H
+#define SPECTRALTRACER_H
+
+#include <QList>
+#include <QVector>
+#include <QRectF>
+
+#include "rayemitter.h"
+#include "spectrum.h"
+#include "thicklens.h"
+
+// Straight piece of a traced sub-ray
+struct SpectralSegment
+{
+    float x1;
+    float y1;
+    float x2;
+    float y2;
+    QRgb color;
+};
+
+// Traces polychromatic emitters as one sub-ray per sampled wavelength. The
+// part of the ray before the lens is the same for every wavelength and is
+// stored once with the color of all the samples added up.
+class SpectralTracer
+{
+public:
+    SpectralTracer();
+
+    void setDispersion(const Dispersion &dispersion);
+
+    // In lean mode only the parts of segments inside the visible rect are
+    // kept, segments outside of it are not stored at all
+    void setLeanMode(bool lean);
+    bool leanMode() const;
+
+    void setVisibleRect(const QRectF &rect);
+
+    // Monochromatic emitters are skipped
+    void traceThinLens(const QList<RayEmitter> &emitters, qreal focalLength);
+    void traceThickLens(const QList<RayEmitter> &emitters, const ThickLens &lens);
+
+    const QVector<SpectralSegment>& segments() const;
+
+private:
+    // Per-wavelength data shared by the emitters with the same spectrum
+    struct Samples
+    {
+        Spectrum spectrum;
+        QVector<qreal> wavelengths;
+        QVector<QRgb> colors;
+    };
+
+    // Index in m_samples, computed on first use
+    int samplesIndex(const Spectrum &spectrum);
+
+    void addSegment(const QPointF &a, const QPointF &b, QRgb color);
+
+    Dispersion m_dispersion;
+    bool m_leanMode;
+    QRectF m_visibleRect;
+
+    QList<Samples> m_samples;
+    QVector<SpectralSegment> m_segments;
+};
+
+#endif // SPECTRALTRACER_H
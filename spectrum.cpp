@@ -0,0 +1,222 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "spectrum.h"
+
+#include <qmath.h>
+
+// Refractive index of a typical crown glass, used for thin lenses
+const qreal kThinLensIndex = 1.5168;
+
+Spectrum::Spectrum(int samples, qreal minWavelength, qreal maxWavelength) :
+    m_samples(qMax(1, samples)),
+    m_minWavelength(minWavelength),
+    m_maxWavelength(maxWavelength)
+{
+}
+
+int Spectrum::samples() const
+{
+    return m_samples;
+}
+
+qreal Spectrum::minWavelength() const
+{
+    return m_minWavelength;
+}
+
+qreal Spectrum::maxWavelength() const
+{
+    return m_maxWavelength;
+}
+
+bool Spectrum::isMonochromatic() const
+{
+    return m_samples == 1;
+}
+
+qreal Spectrum::wavelengthAt(int sample) const
+{
+    if (m_samples == 1) {
+        return kWavelengthD;
+    }
+
+    return m_minWavelength + (m_maxWavelength - m_minWavelength) * sample / (m_samples - 1);
+}
+
+QRgb Spectrum::colorAt(int sample) const
+{
+    qreal total[3] = { 0.0, 0.0, 0.0 };
+
+    for (int i = 0; i < m_samples; i++) {
+        QColor color = wavelengthToColor(wavelengthAt(i));
+        total[0] += color.redF();
+        total[1] += color.greenF();
+        total[2] += color.blueF();
+    }
+
+    QColor color = wavelengthToColor(wavelengthAt(sample));
+
+    qreal r = total[0] > 0 ? color.redF() / total[0] : 0.0;
+    qreal g = total[1] > 0 ? color.greenF() / total[1] : 0.0;
+    qreal b = total[2] > 0 ? color.blueF() / total[2] : 0.0;
+
+    return qRgb(qRound(255 * r), qRound(255 * g), qRound(255 * b));
+}
+
+QColor wavelengthToColor(qreal wavelength)
+{
+    qreal r = 0.0;
+    qreal g = 0.0;
+    qreal b = 0.0;
+
+    const qreal w = wavelength;
+
+    if (w >= 380 && w < 440) {
+        r = (440 - w) / (440 - 380);
+        b = 1.0;
+    } else if (w >= 440 && w < 490) {
+        g = (w - 440) / (490 - 440);
+        b = 1.0;
+    } else if (w >= 490 && w < 510) {
+        g = 1.0;
+        b = (510 - w) / (510 - 490);
+    } else if (w >= 510 && w < 580) {
+        r = (w - 510) / (580 - 510);
+        g = 1.0;
+    } else if (w >= 580 && w < 645) {
+        r = 1.0;
+        g = (645 - w) / (645 - 580);
+    } else if (w >= 645 && w <= 780) {
+        r = 1.0;
+    }
+
+    // Intensity falls off near the limits of vision
+    qreal factor = 0.0;
+
+    if (w >= 380 && w < 420) {
+        factor = 0.3 + 0.7 * (w - 380) / (420 - 380);
+    } else if (w >= 420 && w < 700) {
+        factor = 1.0;
+    } else if (w >= 700 && w <= 780) {
+        factor = 0.3 + 0.7 * (780 - w) / (780 - 700);
+    }
+
+    const qreal gamma = 0.8;
+
+    return QColor::fromRgbF(qPow(r * factor, gamma), qPow(g * factor, gamma),
+                            qPow(b * factor, gamma));
+}
+
+Dispersion::Dispersion() :
+    m_model(NoDispersion),
+    m_abbeNumber(0.0)
+{
+    for (int i = 0; i < 3; i++) {
+        m_b[i] = 0.0;
+        m_c[i] = 0.0;
+    }
+}
+
+Dispersion Dispersion::abbe(qreal abbeNumber)
+{
+    Dispersion dispersion;
+    dispersion.m_model = Abbe;
+    dispersion.m_abbeNumber = abbeNumber;
+
+    return dispersion;
+}
+
+Dispersion Dispersion::sellmeier(const qreal b[3], const qreal c[3])
+{
+    Dispersion dispersion;
+    dispersion.m_model = Sellmeier;
+
+    for (int i = 0; i < 3; i++) {
+        dispersion.m_b[i] = b[i];
+        dispersion.m_c[i] = c[i];
+    }
+
+    dispersion.m_abbeNumber = (dispersion.refractiveIndex(kWavelengthD, 0.0) - 1)
+            / (dispersion.refractiveIndex(kWavelengthF, 0.0)
+               - dispersion.refractiveIndex(kWavelengthC, 0.0));
+
+    return dispersion;
+}
+
+Dispersion::Model Dispersion::model() const
+{
+    return m_model;
+}
+
+qreal Dispersion::abbeNumber() const
+{
+    return m_abbeNumber;
+}
+
+qreal Dispersion::refractiveIndex(qreal wavelength, qreal nd) const
+{
+    // Both equations use micrometers
+    qreal l2 = wavelength * wavelength * 1e-6;
+
+    switch (m_model) {
+    case Abbe: {
+        if (m_abbeNumber <= 0.0) {
+            return nd;
+        }
+
+        qreal lf2 = kWavelengthF * kWavelengthF * 1e-6;
+        qreal lc2 = kWavelengthC * kWavelengthC * 1e-6;
+        qreal ld2 = kWavelengthD * kWavelengthD * 1e-6;
+
+        // n = A + B / l^2 with n(d) = nd and (nd - 1) / (n(F) - n(C)) = V
+        qreal b = (nd - 1) / (m_abbeNumber * (1 / lf2 - 1 / lc2));
+        qreal a = nd - b / ld2;
+
+        return a + b / l2;
+    }
+    case Sellmeier: {
+        qreal n2 = 1.0;
+
+        for (int i = 0; i < 3; i++) {
+            n2 += m_b[i] * l2 / (l2 - m_c[i]);
+        }
+
+        return qSqrt(n2);
+    }
+    default:
+        return nd;
+    }
+}
+
+qreal Dispersion::focalLength(qreal wavelength, qreal focalLength) const
+{
+    if (m_model == NoDispersion) {
+        return focalLength;
+    }
+
+    // Thin lens power is proportional to n - 1
+    qreal nd = refractiveIndex(kWavelengthD, kThinLensIndex);
+    qreal n = refractiveIndex(wavelength, kThinLensIndex);
+
+    return focalLength * (nd - 1) / (n - 1);
+}
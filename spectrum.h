@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <QColor>
+
+// Fraunhofer lines used to define the Abbe number (nm)
+const qreal kWavelengthF = 486.13;
+const qreal kWavelengthD = 587.56;
+const qreal kWavelengthC = 656.27;
+
+// Wavelengths sampled evenly over a range. A spectrum with one sample is
+// monochromatic and is drawn with the emitter's own color.
+class Spectrum
+{
+public:
+    explicit Spectrum(int samples = 1, qreal minWavelength = 400.0,
+                      qreal maxWavelength = 700.0);
+
+    int samples() const;
+    qreal minWavelength() const;
+    qreal maxWavelength() const;
+
+    bool isMonochromatic() const;
+
+    // Wavelength of the sample in nm
+    qreal wavelengthAt(int sample) const;
+
+    // Color of the sample scaled so that all the samples add up to white
+    QRgb colorAt(int sample) const;
+
+private:
+    int m_samples;
+    qreal m_minWavelength;
+    qreal m_maxWavelength;
+};
+
+// Approximate color of monochromatic light
+QColor wavelengthToColor(qreal wavelength);
+
+// Dependence of the refractive index of the lens glass on wavelength
+class Dispersion
+{
+public:
+    enum Model {
+        // Refractive index does not depend on wavelength
+        NoDispersion,
+        // Cauchy's equation fitted to the Abbe number
+        Abbe,
+        // Sellmeier equation for a specific glass
+        Sellmeier
+    };
+
+    Dispersion();
+
+    static Dispersion abbe(qreal abbeNumber);
+
+    // Coefficients C are in square micrometers
+    static Dispersion sellmeier(const qreal b[3], const qreal c[3]);
+
+    Model model() const;
+
+    qreal abbeNumber() const;
+
+    // Refractive index at the wavelength (nm) of a glass which has index nd
+    // at the d line. Sellmeier glasses ignore nd.
+    qreal refractiveIndex(qreal wavelength, qreal nd) const;
+
+    // Focal length of a thin lens at the wavelength if it is focalLength at
+    // the d line
+    qreal focalLength(qreal wavelength, qreal focalLength) const;
+
+private:
+    Model m_model;
+    qreal m_abbeNumber;
+    qreal m_b[3];
+    qreal m_c[3];
+};
+
+#endif // SPECTRUM_H
@@ -0,0 +1,521 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "thicklens.h"
+
+#include <QtConcurrentMap>
+#include <qmath.h>
+
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const qreal kFlatLensAperture = 50.0;
+const qreal kApertureMargin = 0.95;
+
+// Rays traced by one thread at a time
+const int kTraceChunkSize = 16384;
+
+ThickLens::ThickLens() :
+    m_frontRadius(40.0),
+    m_backRadius(-40.0),
+    m_thickness(6.0),
+    m_refractiveIndex(1.5)
+{
+}
+
+ThickLens::ThickLens(qreal frontRadius, qreal backRadius, qreal thickness,
+                     qreal refractiveIndex) :
+    m_frontRadius(frontRadius),
+    m_backRadius(backRadius),
+    m_thickness(thickness),
+    m_refractiveIndex(refractiveIndex)
+{
+}
+
+qreal ThickLens::frontRadius() const
+{
+    return m_frontRadius;
+}
+
+void ThickLens::setFrontRadius(qreal radius)
+{
+    m_frontRadius = radius;
+}
+
+qreal ThickLens::backRadius() const
+{
+    return m_backRadius;
+}
+
+void ThickLens::setBackRadius(qreal radius)
+{
+    m_backRadius = radius;
+}
+
+qreal ThickLens::thickness() const
+{
+    return m_thickness;
+}
+
+void ThickLens::setThickness(qreal thickness)
+{
+    m_thickness = thickness;
+}
+
+qreal ThickLens::refractiveIndex() const
+{
+    return m_refractiveIndex;
+}
+
+void ThickLens::setRefractiveIndex(qreal index)
+{
+    m_refractiveIndex = index;
+}
+
+qreal ThickLens::aperture() const
+{
+    qreal aperture = kFlatLensAperture;
+
+    if (m_frontRadius != 0.0) {
+        aperture = qAbs(m_frontRadius);
+    }
+
+    if (m_backRadius != 0.0) {
+        aperture = qMin(aperture, qAbs(m_backRadius));
+    }
+
+    aperture *= kApertureMargin;
+
+    // Surfaces must not cross each other at the edge
+    while (aperture > 0.1 && backVertex() + backSag(aperture)
+           < frontVertex() + frontSag(aperture)) {
+        aperture *= kApertureMargin;
+    }
+
+    return aperture;
+}
+
+qreal ThickLens::focalLength() const
+{
+    qreal n = m_refractiveIndex;
+
+    qreal c1 = m_frontRadius == 0.0 ? 0.0 : 1.0 / m_frontRadius;
+    qreal c2 = m_backRadius == 0.0 ? 0.0 : 1.0 / m_backRadius;
+
+    qreal power = (n - 1) * (c1 - c2 + (n - 1) * m_thickness * c1 * c2 / n);
+
+    return power == 0.0 ? 0.0 : 1.0 / power;
+}
+
+qreal ThickLens::frontVertex() const
+{
+    return -m_thickness / 2;
+}
+
+qreal ThickLens::backVertex() const
+{
+    return m_thickness / 2;
+}
+
+static qreal sag(qreal radius, qreal y)
+{
+    if (radius == 0.0) {
+        return 0.0;
+    }
+
+    qreal root = qSqrt(qMax(qreal(0.0), radius * radius - y * y));
+    return radius > 0 ? radius - root : radius + root;
+}
+
+qreal ThickLens::frontSag(qreal y) const
+{
+    return sag(m_frontRadius, y);
+}
+
+qreal ThickLens::backSag(qreal y) const
+{
+    return sag(m_backRadius, y);
+}
+
+void RayBatch::resize(int size)
+{
+    x.resize(size);
+    y.resize(size);
+    dx.resize(size);
+    dy.resize(size);
+}
+
+int RayBatch::size() const
+{
+    return x.size();
+}
+
+void ThickLensTraceBatch::resize(int size)
+{
+    x1.resize(size);
+    y1.resize(size);
+    x2.resize(size);
+    y2.resize(size);
+    dx1.resize(size);
+    dy1.resize(size);
+    dx2.resize(size);
+    dy2.resize(size);
+    status.resize(size);
+}
+
+int ThickLensTraceBatch::size() const
+{
+    return status.size();
+}
+
+namespace
+{
+
+// One refracting surface, precomputed for the trace kernels
+struct Surface
+{
+    Surface(qreal vertex, qreal radius, qreal n1, qreal n2, qreal aperture)
+        : vertex(vertex), radius(radius), center(vertex + radius),
+          side(radius > 0 ? 1.0 : -1.0), flat(radius == 0.0),
+          eta(n1 / n2), aperture(aperture) {}
+
+    double vertex;
+    double radius;
+    double center;
+
+    // Picks the intersection on the vertex side of the sphere
+    double side;
+    bool flat;
+
+    // Ratio of refractive indices before and after the surface
+    double eta;
+    double aperture;
+};
+
+// Input and output arrays of one surface pass
+struct SurfacePass
+{
+    const double *x;
+    const double *y;
+    const double *dx;
+    const double *dy;
+
+    double *hitX;
+    double *hitY;
+    double *outDx;
+    double *outDy;
+
+    quint8 *status;
+
+    // Status of rays which miss the surface
+    quint8 missStatus;
+
+    // Put hit point of missed rays on the vertex plane
+    bool missToPlane;
+};
+
+void refractScalar(const Surface &s, const SurfacePass &pass, int i)
+{
+    double px = pass.x[i];
+    double py = pass.y[i];
+    double dx = pass.dx[i];
+    double dy = pass.dy[i];
+
+    double t;
+    bool miss = false;
+
+    if (s.flat) {
+        t = (s.vertex - px) / dx;
+    } else {
+        double ox = px - s.center;
+        double b = ox * dx + py * dy;
+        double c = ox * ox + py * py - s.radius * s.radius;
+        double disc = b * b - c;
+
+        miss = disc < 0;
+        t = -b - s.side * std::sqrt(qMax(0.0, disc));
+    }
+
+    double hx = px + t * dx;
+    double hy = py + t * dy;
+
+    miss = miss || !(t > 0) || qAbs(hy) > s.aperture;
+
+    if (miss) {
+        pass.status[i] = pass.missStatus;
+
+        if (pass.missToPlane) {
+            t = (s.vertex - px) / dx;
+            pass.hitX[i] = s.vertex;
+            pass.hitY[i] = py + t * dy;
+        }
+
+        return;
+    }
+
+    double nx = -1.0;
+    double ny = 0.0;
+
+    if (!s.flat) {
+        nx = (hx - s.center) / s.radius;
+        ny = hy / s.radius;
+    }
+
+    double cosi = -(nx * dx + ny * dy);
+    double k = 1.0 - s.eta * s.eta * (1.0 - cosi * cosi);
+
+    pass.hitX[i] = hx;
+    pass.hitY[i] = hy;
+
+    if (k < 0) {
+        pass.status[i] = ThickLensTraceBatch::TotalReflection;
+        pass.outDx[i] = dx + 2 * cosi * nx;
+        pass.outDy[i] = dy + 2 * cosi * ny;
+    } else {
+        double f = s.eta * cosi - std::sqrt(k);
+        pass.outDx[i] = s.eta * dx + f * nx;
+        pass.outDy[i] = s.eta * dy + f * ny;
+    }
+}
+
+#ifdef __SSE2__
+inline __m128d select(__m128d mask, __m128d a, __m128d b)
+{
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+// Same as refractScalar for rays i and i + 1
+void refractSse2(const Surface &s, const SurfacePass &pass, int i)
+{
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d signMask = _mm_set1_pd(-0.0);
+
+    const __m128d vertex = _mm_set1_pd(s.vertex);
+    const __m128d center = _mm_set1_pd(s.center);
+    const __m128d eta = _mm_set1_pd(s.eta);
+
+    __m128d px = _mm_loadu_pd(pass.x + i);
+    __m128d py = _mm_loadu_pd(pass.y + i);
+    __m128d dx = _mm_loadu_pd(pass.dx + i);
+    __m128d dy = _mm_loadu_pd(pass.dy + i);
+
+    __m128d t;
+    __m128d miss;
+
+    __m128d nx;
+    __m128d ny;
+
+    if (s.flat) {
+        t = _mm_div_pd(_mm_sub_pd(vertex, px), dx);
+        miss = zero;
+    } else {
+        __m128d radius = _mm_set1_pd(s.radius);
+
+        __m128d ox = _mm_sub_pd(px, center);
+        __m128d b = _mm_add_pd(_mm_mul_pd(ox, dx), _mm_mul_pd(py, dy));
+        __m128d c = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(ox, ox), _mm_mul_pd(py, py)),
+                               _mm_mul_pd(radius, radius));
+        __m128d disc = _mm_sub_pd(_mm_mul_pd(b, b), c);
+
+        miss = _mm_cmplt_pd(disc, zero);
+
+        __m128d root = _mm_sqrt_pd(_mm_max_pd(disc, zero));
+        t = _mm_sub_pd(_mm_sub_pd(zero, b), _mm_mul_pd(_mm_set1_pd(s.side), root));
+    }
+
+    __m128d hx = _mm_add_pd(px, _mm_mul_pd(t, dx));
+    __m128d hy = _mm_add_pd(py, _mm_mul_pd(t, dy));
+
+    // !(t > 0) is also true for NaN
+    miss = _mm_or_pd(miss, _mm_cmpngt_pd(t, zero));
+    miss = _mm_or_pd(miss, _mm_cmpgt_pd(_mm_andnot_pd(signMask, hy),
+                                        _mm_set1_pd(s.aperture)));
+
+    if (s.flat) {
+        nx = _mm_set1_pd(-1.0);
+        ny = zero;
+    } else {
+        __m128d invRadius = _mm_set1_pd(1.0 / s.radius);
+        nx = _mm_mul_pd(_mm_sub_pd(hx, center), invRadius);
+        ny = _mm_mul_pd(hy, invRadius);
+    }
+
+    __m128d cosi = _mm_sub_pd(zero, _mm_add_pd(_mm_mul_pd(nx, dx), _mm_mul_pd(ny, dy)));
+    __m128d k = _mm_sub_pd(one, _mm_mul_pd(_mm_mul_pd(eta, eta),
+                                           _mm_sub_pd(one, _mm_mul_pd(cosi, cosi))));
+    __m128d tir = _mm_cmplt_pd(k, zero);
+
+    __m128d f = _mm_sub_pd(_mm_mul_pd(eta, cosi), _mm_sqrt_pd(_mm_max_pd(k, zero)));
+    __m128d refractedX = _mm_add_pd(_mm_mul_pd(eta, dx), _mm_mul_pd(f, nx));
+    __m128d refractedY = _mm_add_pd(_mm_mul_pd(eta, dy), _mm_mul_pd(f, ny));
+
+    __m128d reflectedX = _mm_add_pd(dx, _mm_mul_pd(_mm_mul_pd(two, cosi), nx));
+    __m128d reflectedY = _mm_add_pd(dy, _mm_mul_pd(_mm_mul_pd(two, cosi), ny));
+
+    if (pass.missToPlane) {
+        __m128d planeT = _mm_div_pd(_mm_sub_pd(vertex, px), dx);
+        hx = select(miss, vertex, hx);
+        hy = select(miss, _mm_add_pd(py, _mm_mul_pd(planeT, dy)), hy);
+    }
+
+    _mm_storeu_pd(pass.hitX + i, hx);
+    _mm_storeu_pd(pass.hitY + i, hy);
+    _mm_storeu_pd(pass.outDx + i, select(tir, reflectedX, refractedX));
+    _mm_storeu_pd(pass.outDy + i, select(tir, reflectedY, refractedY));
+
+    int missBits = _mm_movemask_pd(miss);
+    int tirBits = _mm_movemask_pd(tir);
+
+    for (int lane = 0; lane < 2; lane++) {
+        if (missBits & (1 << lane)) {
+            pass.status[i + lane] = pass.missStatus;
+        } else if (tirBits & (1 << lane)) {
+            pass.status[i + lane] = ThickLensTraceBatch::TotalReflection;
+        }
+    }
+}
+#endif
+
+// Rays with status other than Passed are left as they are
+void refractSurface(const Surface &s, const SurfacePass &pass, int begin, int end)
+{
+    int i = begin;
+
+#ifdef __SSE2__
+    for (; i + 1 < end; i += 2) {
+        bool alive0 = pass.status[i] == ThickLensTraceBatch::Passed;
+        bool alive1 = pass.status[i + 1] == ThickLensTraceBatch::Passed;
+
+        if (alive0 && alive1) {
+            refractSse2(s, pass, i);
+        } else {
+            if (alive0) {
+                refractScalar(s, pass, i);
+            }
+
+            if (alive1) {
+                refractScalar(s, pass, i + 1);
+            }
+        }
+    }
+#endif
+
+    for (; i < end; i++) {
+        if (pass.status[i] == ThickLensTraceBatch::Passed) {
+            refractScalar(s, pass, i);
+        }
+    }
+}
+
+struct TraceChunk
+{
+    int begin;
+    int end;
+};
+
+class ThickLensKernel
+{
+public:
+    ThickLensKernel(const Surface &front, const Surface &back,
+                    const SurfacePass &frontPass, const SurfacePass &backPass)
+        : m_front(front), m_back(back),
+          m_frontPass(frontPass), m_backPass(backPass) {}
+
+    void operator()(const TraceChunk &chunk) const
+    {
+        for (int i = chunk.begin; i < chunk.end; i++) {
+            m_frontPass.status[i] = ThickLensTraceBatch::Passed;
+        }
+
+        refractSurface(m_front, m_frontPass, chunk.begin, chunk.end);
+        refractSurface(m_back, m_backPass, chunk.begin, chunk.end);
+    }
+
+private:
+    Surface m_front;
+    Surface m_back;
+    SurfacePass m_frontPass;
+    SurfacePass m_backPass;
+};
+
+}
+
+void traceThickLens(const ThickLens &lens, const RayBatch &rays,
+                    ThickLensTraceBatch &result)
+{
+    int count = rays.size();
+    result.resize(count);
+
+    qreal n = lens.refractiveIndex();
+    qreal aperture = lens.aperture();
+
+    Surface front(lens.frontVertex(), lens.frontRadius(), 1.0, n, aperture);
+    Surface back(lens.backVertex(), lens.backRadius(), n, 1.0, aperture);
+
+    SurfacePass frontPass;
+    frontPass.x = rays.x.constData();
+    frontPass.y = rays.y.constData();
+    frontPass.dx = rays.dx.constData();
+    frontPass.dy = rays.dy.constData();
+    frontPass.hitX = result.x1.data();
+    frontPass.hitY = result.y1.data();
+    frontPass.outDx = result.dx1.data();
+    frontPass.outDy = result.dy1.data();
+    frontPass.status = result.status.data();
+    frontPass.missStatus = ThickLensTraceBatch::MissedFront;
+    frontPass.missToPlane = true;
+
+    SurfacePass backPass;
+    backPass.x = frontPass.hitX;
+    backPass.y = frontPass.hitY;
+    backPass.dx = frontPass.outDx;
+    backPass.dy = frontPass.outDy;
+    backPass.hitX = result.x2.data();
+    backPass.hitY = result.y2.data();
+    backPass.outDx = result.dx2.data();
+    backPass.outDy = result.dy2.data();
+    backPass.status = frontPass.status;
+    backPass.missStatus = ThickLensTraceBatch::MissedBack;
+    backPass.missToPlane = false;
+
+    ThickLensKernel kernel(front, back, frontPass, backPass);
+
+    QVector<TraceChunk> chunks;
+
+    for (int begin = 0; begin < count; begin += kTraceChunkSize) {
+        TraceChunk chunk;
+        chunk.begin = begin;
+        chunk.end = qMin(count, begin + kTraceChunkSize);
+        chunks.append(chunk);
+    }
+
+    if (chunks.size() == 1) {
+        kernel(chunks.first());
+    } else if (chunks.size() > 1) {
+        QtConcurrent::blockingMap(chunks, kernel);
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef THICKLENS_H
+#define THICKLENS_H
+
+#include <QVector>
+
+// Lens bounded by two spherical surfaces, centered at x = 0. The front
+// surface vertex is at -thickness / 2, the back one at thickness / 2.
+//
+// Radii follow the usual sign convention: positive if the center of
+// curvature lies to the right of the vertex. Zero radius means a flat
+// surface.
+class ThickLens
+{
+public:
+    ThickLens();
+    ThickLens(qreal frontRadius, qreal backRadius, qreal thickness,
+              qreal refractiveIndex);
+
+    qreal frontRadius() const;
+    void setFrontRadius(qreal radius);
+
+    qreal backRadius() const;
+    void setBackRadius(qreal radius);
+
+    qreal thickness() const;
+    void setThickness(qreal thickness);
+
+    qreal refractiveIndex() const;
+    void setRefractiveIndex(qreal index);
+
+    // Half of the lens height. Limited by the smaller of the radii.
+    qreal aperture() const;
+
+    // Paraxial effective focal length (lensmaker's equation). Zero if the
+    // lens has no optical power.
+    qreal focalLength() const;
+
+    qreal frontVertex() const;
+    qreal backVertex() const;
+
+    // Distance along x from the vertex to the surface at the given height
+    qreal frontSag(qreal y) const;
+    qreal backSag(qreal y) const;
+
+private:
+    qreal m_frontRadius;
+    qreal m_backRadius;
+    qreal m_thickness;
+    qreal m_refractiveIndex;
+};
+
+// Rays stored as structure of arrays: origins and unit directions
+struct RayBatch
+{
+    void resize(int size);
+    int size() const;
+
+    QVector<double> x;
+    QVector<double> y;
+    QVector<double> dx;
+    QVector<double> dy;
+};
+
+// Result of tracing a RayBatch through a ThickLens
+struct ThickLensTraceBatch
+{
+    enum Status {
+        // Passed both surfaces
+        Passed,
+        // Missed the front surface (hit point 1 is on the front vertex plane)
+        MissedFront,
+        // Missed the back surface inside the lens
+        MissedBack,
+        // Totally reflected at the back surface; direction is the reflected one
+        TotalReflection
+    };
+
+    void resize(int size);
+    int size() const;
+
+    // Hit points on the front and back surfaces
+    QVector<double> x1;
+    QVector<double> y1;
+    QVector<double> x2;
+    QVector<double> y2;
+
+    // Direction inside the lens
+    QVector<double> dx1;
+    QVector<double> dy1;
+
+    // Direction after the back surface
+    QVector<double> dx2;
+    QVector<double> dy2;
+
+    QVector<quint8> status;
+};
+
+// Exact trace with vector form of Snell's law. Rays must travel towards
+// positive x. Large batches are split between threads.
+void traceThickLens(const ThickLens &lens, const RayBatch &rays,
+                    ThickLensTraceBatch &result);
+
+#endif // THICKLENS_H
@@ -0,0 +1,227 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "tracebenchmark.h"
+#include "raytracer.h"
+#include "json.h"
+
+#include <QLocalSocket>
+#include <QTextStream>
+#include <QVariant>
+#include <QtAlgorithms>
+
+#include <cstdlib>
+
+const int kDefaultRayCount = 10000;
+const int kDefaultRequestCount = 1000;
+const int kDefaultPipelineDepth = 8;
+
+TraceBenchmark::TraceBenchmark(QObject *parent) :
+    QObject(parent),
+    m_socket(new QLocalSocket(this)),
+    m_rayCount(kDefaultRayCount),
+    m_requestCount(kDefaultRequestCount),
+    m_pipelineDepth(kDefaultPipelineDepth),
+    m_binary(false),
+    m_sent(0),
+    m_received(0),
+    m_pendingBytes(0)
+{
+    connect(m_socket, SIGNAL(connected()), SLOT(sendRequests()));
+    connect(m_socket, SIGNAL(readyRead()), SLOT(readReplies()));
+    connect(m_socket, SIGNAL(error(QLocalSocket::LocalSocketError)),
+            SLOT(socketError()));
+}
+
+void TraceBenchmark::setServerName(const QString &name)
+{
+    m_serverName = name;
+}
+
+void TraceBenchmark::setRayCount(int count)
+{
+    m_rayCount = qMax(1, count);
+}
+
+void TraceBenchmark::setRequestCount(int count)
+{
+    m_requestCount = qMax(1, count);
+}
+
+void TraceBenchmark::setPipelineDepth(int depth)
+{
+    m_pipelineDepth = qMax(1, depth);
+}
+
+void TraceBenchmark::setBinary(bool binary)
+{
+    m_binary = binary;
+}
+
+void TraceBenchmark::start()
+{
+    prepareBatch();
+
+    m_sent = 0;
+    m_received = 0;
+    m_pendingBytes = 0;
+    m_buffer.clear();
+    m_sendTimes.clear();
+    m_latencies.clear();
+
+    m_socket->connectToServer(m_serverName);
+}
+
+void TraceBenchmark::prepareBatch()
+{
+    // The same random batch is sent with every request
+    QVector<double> emitters(m_rayCount * kEmitterSize);
+
+    for (int i = 0; i < m_rayCount; i++) {
+        emitters[i * kEmitterSize] = -1.0 - 99.0 * qrand() / RAND_MAX;
+        emitters[i * kEmitterSize + 1] = 50.0 - 100.0 * qrand() / RAND_MAX;
+        emitters[i * kEmitterSize + 2] = 0.5 - 1.0 * qrand() / RAND_MAX;
+    }
+
+    if (m_binary) {
+        m_params = ",\"params\":{\"focalLength\":20,\"binary\":true,\"count\":"
+                + QByteArray::number(m_rayCount) + "}}\n";
+        m_payload = QByteArray(reinterpret_cast<const char *>(emitters.constData()),
+                               emitters.size() * static_cast<int>(sizeof(double)));
+    } else {
+        m_params = ",\"params\":{\"focalLength\":20,\"emitters\":[";
+
+        for (int i = 0; i < m_rayCount; i++) {
+            m_params += i == 0 ? "[" : ",[";
+            m_params += QByteArray::number(emitters[i * kEmitterSize], 'g', 17) + ','
+                    + QByteArray::number(emitters[i * kEmitterSize + 1], 'g', 17) + ','
+                    + QByteArray::number(emitters[i * kEmitterSize + 2], 'g', 17) + ']';
+        }
+
+        m_params += "]}}\n";
+        m_payload.clear();
+    }
+}
+
+void TraceBenchmark::sendRequests()
+{
+    if (m_sent == 0) {
+        m_timer.start();
+    }
+
+    while (m_sent < m_requestCount && m_sent - m_received < m_pipelineDepth) {
+        int id = m_sent++;
+
+        m_sendTimes.insert(id, m_timer.nsecsElapsed());
+
+        m_socket->write("{\"jsonrpc\":\"2.0\",\"method\":\"trace\",\"id\":"
+                        + QByteArray::number(id) + m_params);
+
+        if (!m_payload.isEmpty()) {
+            m_socket->write(m_payload);
+        }
+    }
+}
+
+void TraceBenchmark::readReplies()
+{
+    m_buffer += m_socket->readAll();
+
+    int pos = 0;
+
+    forever {
+        if (m_pendingBytes > 0) {
+            if (m_buffer.size() - pos < m_pendingBytes) {
+                break;
+            }
+
+            pos += m_pendingBytes;
+            m_pendingBytes = 0;
+            continue;
+        }
+
+        int eol = m_buffer.indexOf('\n', pos);
+
+        if (eol == -1) {
+            break;
+        }
+
+        QVariantMap reply = Json::parse(m_buffer.mid(pos, eol - pos)).toMap();
+        pos = eol + 1;
+
+        if (reply.contains("error")) {
+            QTextStream(stderr) << "Server error: "
+                                << reply.value("error").toMap().value("message").toString()
+                                << endl;
+            emit finished(1);
+            return;
+        }
+
+        int id = reply.value("id").toInt();
+        m_latencies.append(m_timer.nsecsElapsed() - m_sendTimes.take(id));
+        m_received++;
+
+        m_pendingBytes = reply.value("result").toMap().value("bytes").toInt();
+    }
+
+    m_buffer.remove(0, pos);
+
+    if (m_received == m_requestCount && m_pendingBytes == 0) {
+        report();
+        m_socket->disconnectFromServer();
+        emit finished(0);
+    } else {
+        sendRequests();
+    }
+}
+
+void TraceBenchmark::socketError()
+{
+    QTextStream(stderr) << "Connection error: " << m_socket->errorString() << endl;
+    emit finished(1);
+}
+
+void TraceBenchmark::report()
+{
+    qreal seconds = m_timer.nsecsElapsed() / 1e9;
+
+    qSort(m_latencies);
+
+    QTextStream out(stdout);
+
+    out << "requests:    " << m_requestCount << " x " << m_rayCount << " rays"
+        << (m_binary ? " (binary)" : " (json)") << endl;
+    out << "pipeline:    " << m_pipelineDepth << endl;
+    out << "throughput:  " << m_requestCount / seconds << " requests/s, "
+        << static_cast<qint64>(m_requestCount * static_cast<qreal>(m_rayCount) / seconds)
+        << " rays/s" << endl;
+
+    const int percentiles[] = { 50, 90, 99, 100 };
+
+    for (int i = 0; i < 4; i++) {
+        int index = qMin(m_latencies.size() - 1,
+                         m_latencies.size() * percentiles[i] / 100);
+
+        out << "latency p" << percentiles[i] << ": "
+            << m_latencies.at(index) / 1e6 << " ms" << endl;
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TRACEBENCHMARK_H
+#define TRACEBENCHMARK_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QElapsedTimer>
+
+class QLocalSocket;
+
+// Client that measures throughput and latency of a TraceServer. Keeps up
+// to pipelineDepth() requests in flight and prints a report once all of
+// them are answered.
+class TraceBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TraceBenchmark(QObject *parent = 0);
+
+    void setServerName(const QString &name);
+
+    // Emitters per request
+    void setRayCount(int count);
+    void setRequestCount(int count);
+    void setPipelineDepth(int depth);
+
+    // Send emitters and receive traces as raw doubles instead of JSON arrays
+    void setBinary(bool binary);
+
+public slots:
+    void start();
+
+signals:
+    // Result is zero on success
+    void finished(int result);
+
+private slots:
+    void sendRequests();
+    void readReplies();
+    void socketError();
+
+private:
+    void prepareBatch();
+    void report();
+
+    QLocalSocket *m_socket;
+    QString m_serverName;
+
+    int m_rayCount;
+    int m_requestCount;
+    int m_pipelineDepth;
+    bool m_binary;
+
+    QByteArray m_params;
+    QByteArray m_payload;
+
+    int m_sent;
+    int m_received;
+    QByteArray m_buffer;
+    int m_pendingBytes;
+
+    QElapsedTimer m_timer;
+    QHash<int, qint64> m_sendTimes;
+    QVector<qint64> m_latencies;
+};
+
+#endif // TRACEBENCHMARK_H
@@ -0,0 +1,374 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#include "traceserver.h"
+#include "raytracer.h"
+#include "json.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QRunnable>
+#include <QVector>
+#include <QDebug>
+
+#include <cstring>
+
+enum JsonRpcError {
+    ParseError = -32700,
+    InvalidRequest = -32600,
+    MethodNotFound = -32601,
+    InvalidParams = -32602
+};
+
+// Upper bound on the emitters of one binary request, which keeps the
+// payload size well inside an int
+const int kMaxBinaryEmitters = 1 << 22;
+
+// Longest request line a client may send, so that a line which never ends
+// can not use up the memory
+const int kMaxLineLength = 1 << 20;
+
+class TraceJob : public QRunnable
+{
+public:
+    TraceJob(TraceServer *server, int connection, const QVariantMap &request,
+             const QByteArray &payload)
+        : m_server(server), m_connection(connection), m_request(request),
+          m_payload(payload) {}
+
+    void run()
+    {
+        QByteArray header;
+        QByteArray payload;
+
+        trace(header, payload);
+
+        QMetaObject::invokeMethod(m_server, "sendReply", Qt::QueuedConnection,
+                                  Q_ARG(int, m_connection),
+                                  Q_ARG(QByteArray, header),
+                                  Q_ARG(QByteArray, payload));
+    }
+
+private:
+    void trace(QByteArray &header, QByteArray &payload)
+    {
+        QVariant id = m_request.value("id");
+        QVariantMap params = m_request.value("params").toMap();
+
+        bool ok;
+        qreal focalLength = params.value("focalLength").toDouble(&ok);
+
+        if (!ok || focalLength == 0.0) {
+            header = TraceServer::errorReply(id, InvalidParams,
+                                             "focalLength must be a non-zero number");
+            return;
+        }
+
+        bool binary = params.value("binary").toBool();
+
+        QVector<double> emitterData;
+        const double *emitters = 0;
+        int count = 0;
+
+        if (binary) {
+            count = m_payload.size() / static_cast<int>(kEmitterSize * sizeof(double));
+            emitters = reinterpret_cast<const double *>(m_payload.constData());
+
+            // The payload is used in place unless it is misaligned
+            if (reinterpret_cast<quintptr>(emitters) % sizeof(double) != 0) {
+                emitterData.resize(count * kEmitterSize);
+                std::memcpy(emitterData.data(), m_payload.constData(),
+                            emitterData.size() * sizeof(double));
+                emitters = emitterData.constData();
+            }
+        } else {
+            QVariantList list = params.value("emitters").toList();
+            count = list.size();
+            emitterData.resize(count * kEmitterSize);
+
+            for (int i = 0; i < count; i++) {
+                QVariantList em = list.at(i).toList();
+
+                if (em.size() != kEmitterSize) {
+                    header = TraceServer::errorReply(id, InvalidParams,
+                                                     "emitters must be [x, y, angle] arrays");
+                    return;
+                }
+
+                for (int j = 0; j < kEmitterSize; j++) {
+                    emitterData[i * kEmitterSize + j] = em.at(j).toDouble();
+                }
+            }
+
+            emitters = emitterData.constData();
+        }
+
+        QByteArray result;
+        result.resize(count * kThinLensTraceSize * static_cast<int>(sizeof(double)));
+        double *rays = reinterpret_cast<double *>(result.data());
+
+        traceThinLens(emitters, count, focalLength, rays);
+
+        header = "{\"jsonrpc\":\"2.0\",\"id\":" + Json::serialize(id)
+                + ",\"result\":{\"count\":" + QByteArray::number(count);
+
+        if (binary) {
+            // Sent as is right after the header
+            header += ",\"bytes\":" + QByteArray::number(result.size()) + "}}\n";
+            payload = result;
+        } else {
+            header += ",\"rays\":[";
+
+            for (int i = 0; i < count; i++) {
+                header += i == 0 ? "[" : ",[";
+
+                for (int j = 0; j < kThinLensTraceSize; j++) {
+                    if (j > 0) {
+                        header += ',';
+                    }
+
+                    header += QByteArray::number(rays[i * kThinLensTraceSize + j], 'g', 17);
+                }
+
+                header += ']';
+            }
+
+            header += "]}}\n";
+        }
+    }
+
+    TraceServer *m_server;
+    int m_connection;
+    QVariantMap m_request;
+    QByteArray m_payload;
+};
+
+TraceServer::TraceServer(QObject *parent) :
+    QObject(parent),
+    m_server(new QLocalServer(this)),
+    m_lastId(0)
+{
+    connect(m_server, SIGNAL(newConnection()), SLOT(newConnection()));
+}
+
+TraceServer::~TraceServer()
+{
+    m_pool.waitForDone();
+}
+
+bool TraceServer::listen(const QString &name)
+{
+    QLocalServer::removeServer(name);
+    return m_server->listen(name);
+}
+
+QString TraceServer::errorString() const
+{
+    return m_server->errorString();
+}
+
+void TraceServer::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(count);
+}
+
+void TraceServer::newConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        int id = ++m_lastId;
+
+        Connection connection;
+        connection.socket = socket;
+        connection.pendingBytes = 0;
+
+        m_ids.insert(socket, id);
+        m_connections.insert(id, connection);
+
+        connect(socket, SIGNAL(readyRead()), SLOT(readRequests()));
+        connect(socket, SIGNAL(disconnected()), SLOT(disconnected()));
+    }
+}
+
+void TraceServer::readRequests()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+    if (!socket || !m_ids.contains(socket)) {
+        return;
+    }
+
+    // Input of a connection being closed after an error is dropped
+    if (socket->state() != QLocalSocket::ConnectedState) {
+        socket->readAll();
+        return;
+    }
+
+    int id = m_ids.value(socket);
+    Connection &c = m_connections[id];
+
+    c.buffer += socket->readAll();
+
+    int pos = 0;
+    bool closing = false;
+
+    forever {
+        if (!c.pendingRequest.isEmpty()) {
+            if (c.buffer.size() - pos < c.pendingBytes) {
+                break;
+            }
+
+            handleRequest(id, c.pendingRequest, c.buffer.mid(pos, c.pendingBytes));
+            pos += c.pendingBytes;
+
+            c.pendingRequest.clear();
+            c.pendingBytes = 0;
+            continue;
+        }
+
+        int eol = c.buffer.indexOf('\n', pos);
+
+        if ((eol == -1 ? c.buffer.size() : eol) - pos > kMaxLineLength) {
+            socket->write(errorReply(QVariant(), InvalidRequest,
+                                     QString("request lines must not exceed %1 bytes")
+                                     .arg(kMaxLineLength)));
+            closing = true;
+            break;
+        }
+
+        if (eol == -1) {
+            break;
+        }
+
+        QByteArray line = c.buffer.mid(pos, eol - pos);
+        pos = eol + 1;
+
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+
+        bool ok;
+        QVariantMap request = Json::parse(line, &ok).toMap();
+
+        if (!ok) {
+            socket->write(errorReply(QVariant(), ParseError, "Parse error"));
+            continue;
+        }
+
+        QVariantMap params = request.value("params").toMap();
+
+        if (params.value("binary").toBool()) {
+            double count = params.value("count").toDouble(&ok);
+
+            if (!ok || count < 0 || count > kMaxBinaryEmitters) {
+                socket->write(errorReply(request.value("id"), InvalidParams,
+                                         QString("count must be between 0 and %1")
+                                         .arg(kMaxBinaryEmitters)));
+
+                // The payload that follows cannot be skipped without its size
+                closing = true;
+                break;
+            }
+
+            if (count > 0) {
+                c.pendingRequest = request;
+                c.pendingBytes = static_cast<int>(count) * kEmitterSize
+                        * static_cast<int>(sizeof(double));
+                continue;
+            }
+        }
+
+        handleRequest(id, request, QByteArray());
+    }
+
+    if (closing) {
+        // Last, since the connection may be removed right away
+        c.buffer.clear();
+        socket->disconnectFromServer();
+        return;
+    }
+
+    c.buffer.remove(0, pos);
+}
+
+void TraceServer::disconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+    if (!socket) {
+        return;
+    }
+
+    m_connections.remove(m_ids.take(socket));
+    socket->deleteLater();
+}
+
+void TraceServer::sendReply(int connection, const QByteArray &header,
+                            const QByteArray &payload)
+{
+    // The client may have gone while the request was traced
+    if (!m_connections.contains(connection)) {
+        return;
+    }
+
+    QLocalSocket *socket = m_connections.value(connection).socket;
+
+    socket->write(header);
+
+    if (!payload.isEmpty()) {
+        socket->write(payload);
+    }
+}
+
+void TraceServer::handleRequest(int connection, const QVariantMap &request,
+                                const QByteArray &payload)
+{
+    QVariant id = request.value("id");
+
+    if (request.value("jsonrpc").toString() != "2.0") {
+        sendReply(connection, errorReply(id, InvalidRequest, "Invalid request"),
+                  QByteArray());
+        return;
+    }
+
+    if (request.value("method").toString() != "trace") {
+        sendReply(connection, errorReply(id, MethodNotFound, "Method not found"),
+                  QByteArray());
+        return;
+    }
+
+    m_pool.start(new TraceJob(this, connection, request, payload));
+}
+
+QByteArray TraceServer::errorReply(const QVariant &id, int code,
+                                   const QString &message)
+{
+    QVariantMap error;
+    error.insert("code", code);
+    error.insert("message", message);
+
+    QVariantMap reply;
+    reply.insert("jsonrpc", "2.0");
+    reply.insert("id", id);
+    reply.insert("error", error);
+
+    return Json::serialize(reply) + '\n';
+}
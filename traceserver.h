@@ -0,0 +1,104 @@
+/*
+ Copyright (c) 2012        Valery Kharitonov <kharvd@gmail.com>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"),
+ to deal in the Software without restriction, including without limitation
+ the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ and/or sell copies of the Software, and to permit persons to whom the Software
+ is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef TRACESERVER_H
+#define TRACESERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QThreadPool>
+#include <QVariant>
+
+class QLocalServer;
+class QLocalSocket;
+
+// Serves thin lens ray traces over a local socket, so that other programs
+// can use them without linking to Qt widgets.
+//
+// The protocol is JSON-RPC 2.0, one message per line. The only method is
+// "trace":
+//
+//   {"jsonrpc": "2.0", "id": 1, "method": "trace",
+//    "params": {"focalLength": 20, "emitters": [[x, y, angle], ...]}}
+//
+// Angles are in radians. The result holds one array per emitter with the
+// lens intersection, the focal plane intersection and the refracted slope:
+//
+//   {"jsonrpc": "2.0", "id": 1,
+//    "result": {"count": 1, "rays": [[lensX, lensY, focalX, focalY, slope]]}}
+//
+// For large batches, "binary": true and "count": N in params mean that the
+// line is followed by N * 3 doubles (x, y, angle) in native byte order
+// instead of the "emitters" array. The reply then has "bytes": B in result
+// and is followed by B bytes of N * 5 doubles in the same layout as above.
+//
+// Requests are traced on a thread pool as soon as they arrive, so clients
+// may send several requests without waiting. Replies are sent in the order
+// they are done and have to be matched by id.
+class TraceServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TraceServer(QObject *parent = 0);
+    ~TraceServer();
+
+    bool listen(const QString &name);
+    QString errorString() const;
+
+    void setMaxThreadCount(int count);
+
+private slots:
+    void newConnection();
+    void readRequests();
+    void disconnected();
+
+    void sendReply(int connection, const QByteArray &header,
+                   const QByteArray &payload);
+
+private:
+    friend class TraceJob;
+
+    struct Connection
+    {
+        QLocalSocket *socket;
+        QByteArray buffer;
+
+        // Header of a binary request waiting for its payload
+        QVariantMap pendingRequest;
+        int pendingBytes;
+    };
+
+    void handleRequest(int connection, const QVariantMap &request,
+                       const QByteArray &payload);
+
+    static QByteArray errorReply(const QVariant &id, int code,
+                                 const QString &message);
+
+    QLocalServer *m_server;
+    QThreadPool m_pool;
+
+    QHash<QLocalSocket *, int> m_ids;
+    QHash<int, Connection> m_connections;
+    int m_lastId;
+};
+
+#endif // TRACESERVER_H